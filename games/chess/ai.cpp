@@ -3,17 +3,33 @@
 
 #include "ai.hpp"
 #include "ai/zobrist.hpp"
+#include "ai/bitboard.hpp"
 #include "ai/action.hpp"
 #include "ai/state.hpp"
 #include "ai/adversarialsearch.hpp"
+#include "ai/transposition.hpp"
+#include "ai/evalcache.hpp"
+#include "ai/searchthreads.hpp"
+#include "ai/timemanager.hpp"
+#include "ai/ponderer.hpp"
+#include "ai/nnue.hpp"
 #include <chrono>
 
 // You can add #includes here for your AI.
 
-const double MAX_COMPUTATION_TIME = 1.00; // Seconds
-const int    QUIESCENCE_LIMIT = 2;        // Moves deep
-std::unordered_map<Action, int> global_history_table;
-std::unordered_map<long, int> global_transposition_table;
+const int    DEFAULT_HASH_SIZE = 64;      // Megabytes, override with --aiSettings hash=N
+const int    DEFAULT_EVAL_CACHE_SIZE = 8; // Megabytes, override with --aiSettings eval_hash=N
+const int    DEFAULT_LMR_BASE = 75;       // Hundredths of a ply, override with --aiSettings lmr_base=N
+const int    DEFAULT_LMR_DIVISOR = 225;   // Hundredths, override with --aiSettings lmr_divisor=N. 0 turns LMR off
+const double PV_CHANGE_EXTENSION = 1.3;   // Soft limit multiplier when the best action changes
+const double FAIL_LOW_EXTENSION = 1.5;    // Soft limit multiplier when the score drops or the root fails low
+const int    FAIL_LOW_MARGIN = MATERIAL_VALUE[PAWN]; // How far the score has to drop
+HistoryTable global_history_table;
+TranspositionTable global_transposition_table(DEFAULT_HASH_SIZE);
+EvalCache global_eval_cache(DEFAULT_EVAL_CACHE_SIZE);
+SearchThreads global_search_threads(&global_transposition_table, &global_eval_cache);
+Ponderer global_ponderer(&global_history_table, &global_transposition_table, &global_eval_cache);
+bool global_pondering_enabled = true;   // Override with --aiSettings ponder=0
 namespace cpp_client
 {
 
@@ -41,6 +57,35 @@ void AI::start()
     //srand(time(NULL));
     srand(0);
     init_zobrist_hash_table();
+    init_bitboards();
+
+    int hash_size = get_int_setting("hash", DEFAULT_HASH_SIZE);
+    if(hash_size != DEFAULT_HASH_SIZE)
+    {
+        global_transposition_table.resize(hash_size);
+    }
+
+    int eval_cache_size = get_int_setting("eval_hash", DEFAULT_EVAL_CACHE_SIZE);
+    if(eval_cache_size != DEFAULT_EVAL_CACHE_SIZE)
+    {
+        global_eval_cache.resize(eval_cache_size);
+    }
+
+    init_late_move_reductions(get_int_setting("lmr_base", DEFAULT_LMR_BASE),
+                              get_int_setting("lmr_divisor", DEFAULT_LMR_DIVISOR));
+
+    // Search threads, including this one. Override with --aiSettings threads=N
+    global_search_threads.set_thread_count(get_int_setting("threads", 1));
+
+    global_pondering_enabled = get_int_setting("ponder", 1) != 0;
+
+    // Evaluate with a network instead of the hand written heuristic
+    // Set with --aiSettings nnue=path/to/network
+    const std::string& network = get_setting("nnue");
+    if(!network.empty() && nnue_load(network))
+    {
+        std::cout << "Evaluating with network " << network << std::endl;
+    }
 }
 
 /// <summary>
@@ -49,6 +94,12 @@ void AI::start()
 void AI::game_updated()
 {
     // If a function you call triggers an update this will be called before it returns.
+
+    // Stop pondering as soon as the opponent doesn't play the move we expected
+    if(global_ponderer.is_running() && opponent_moved() && !global_ponderer.predicted_reply().matches(game->moves.back()))
+    {
+        global_ponderer.stop();
+    }
 }
 
 /// <summary>
@@ -59,6 +110,7 @@ void AI::game_updated()
 void AI::ended(bool won, const std::string& reason)
 {
     // You can do any cleanup of your AI here.  The program ends when this function returns.
+    global_ponderer.stop();
 }
 
 /// <summary>
@@ -89,24 +141,72 @@ bool AI::run_turn()
 
     // 4) Run time-limited alpha-beta pruned iterative deepening minimax
     State state(game);
-    AdversarialSearch search(&global_history_table, &global_transposition_table);
+    TimeManager time_manager(player->time_remaining, game->current_turn);
+    std::cout << "Time budget: " << time_manager.soft_limit() << "s, at most " << time_manager.hard_limit() << "s" << std::endl;
 
+    // If we pondered the move the opponent made, carry on from there.
+    // Otherwise everything found while pondering is for a position
+    // that never happened
     Action best_action = state.available_actions(state.get_active_player())[0];
-    int depth = 1;
-    auto start = std::chrono::system_clock::now();
-    auto end = start;
-    std::chrono::duration<double> seconds_elapsed;
-    do {
-        best_action = search.depth_limited_minimax_search(state, depth, QUIESCENCE_LIMIT);
+    int start_depth = 1;
+    bool ponder_hit = global_ponderer.is_running() && opponent_moved()
+        && global_ponderer.predicted_reply().matches(game->moves.back());
+    global_ponderer.stop();
+    if(ponder_hit)
+    {
+        std::cout << "Ponder hit, searched to depth " << global_ponderer.completed_depth() << std::endl;
+        if(global_ponderer.completed_depth() > 0)
+        {
+            best_action = global_ponderer.best_action();
+            start_depth = global_ponderer.completed_depth() + 1;
+        }
+    }
+    else
+    {
+        global_transposition_table.new_search();
+    }
+    // Cutoffs from earlier turns say less about this position
+    global_history_table.age();
+    AdversarialSearch search(&global_history_table, &global_transposition_table, &global_eval_cache, NULL, &time_manager);
+    global_search_threads.start(state);
+
+    for(int depth = start_depth; depth < MAX_PLY; depth++)
+    {
+        int previous_score = search.get_score();
+        Action action = search.depth_limited_minimax_search(state, depth);
+        if(search.aborted())
+        {
+            std::cout << "Out of time during depth " << depth << std::endl;
+            break;
+        }
+
+        // Give the search longer to settle when it changes its mind
+        if(depth > start_depth && !(action == best_action))
+        {
+            time_manager.extend(PV_CHANGE_EXTENSION);
+        }
+        if(search.failed_low() || (depth > start_depth && search.get_score() < previous_score - FAIL_LOW_MARGIN))
+        {
+            time_manager.extend(FAIL_LOW_EXTENSION);
+        }
+
+        best_action = action;
         std::cout << "Best action for depth " << depth << " :" << best_action << std::endl;
-        end = std::chrono::system_clock::now();
-        seconds_elapsed = end-start;
-        std::cout << "Time elapsed: " << seconds_elapsed.count() << std::endl;
-        depth ++;
-    } while (seconds_elapsed.count() < MAX_COMPUTATION_TIME);
-
-    assert(best_action.m_piece.parent->owner->id == game->current_player->id);
-    best_action.execute();
+        std::cout << "Time elapsed: " << time_manager.elapsed() << std::endl;
+        if(time_manager.soft_limit_reached())
+        {
+            break;
+        }
+    }
+    global_search_threads.stop();
+
+    best_action.execute(game);
+
+    // Search the opponent's most likely reply while they think about it
+    if(global_pondering_enabled && search.get_pv_length() > 1 && search.get_pv(0) == best_action)
+    {
+        global_ponderer.start(state.apply(best_action), search.get_pv(1));
+    }
     return true;
 }
 
@@ -178,6 +278,34 @@ void AI::print_current_board()
 
 // You can add additional methods here for your AI to call
 
+/// <summary>
+/// Tells if the last move in the game was the opponent's
+/// </summary>
+bool AI::opponent_moved() const
+{
+    return game->moves.size() > 0 && game->moves.back()->piece->owner != player;
+}
+
+/// <summary>
+/// Reads an integer setting passed with --aiSettings
+/// </summary>
+/// <param name="key">The key of the setting</param>
+/// <param name="default_value">Returned if the setting is missing or not a number</param>
+/// <returns>The setting's value</returns>
+int AI::get_int_setting(const char* key, int default_value) const
+{
+    const std::string& value = get_setting(key);
+    try
+    {
+        return value.empty() ? default_value : std::stoi(value);
+    }
+    catch(const std::exception&)
+    {
+        std::cerr << "Ignoring non-numeric setting " << key << "=" << value << std::endl;
+        return default_value;
+    }
+}
+
 } // chess
 
 } // cpp_client
@@ -77,6 +77,18 @@ public:
 
     // You can add additional methods here.
 
+    /// <summary>
+    /// Tells if the last move in the game was the opponent's
+    /// </summary>
+    bool opponent_moved() const;
+
+    /// <summary>
+    /// Reads an integer setting passed with --aiSettings
+    /// </summary>
+    /// <param name="key">The key of the setting</param>
+    /// <param name="default_value">Returned if the setting is missing or not a number</param>
+    /// <returns>The setting's value</returns>
+    int get_int_setting(const char* key, int default_value) const;
 
 
     // ####################
@@ -5,6 +5,7 @@
 //////////////////////////////////////////////////////////////////////
 
 #include "action.hpp"
+#include "bitboard.hpp"
 #include <sstream>
 
 std::map<std::string, char> PIECE_CODE_LOOKUP{
@@ -16,46 +17,52 @@ std::map<std::string, char> PIECE_CODE_LOOKUP{
     {"King", 'K'}
 };
 
-const Space INVALID_SPACE = {-1, -1};
+const Action NO_ACTION(0, 0);
 
-void Action::execute() {
-  // Convert location back from zero-indexed
-  auto file = std::string(1, 'a' + char(m_space.file));
-  auto rank = m_space.rank + 1;
-  m_piece.parent->move(file, rank, m_promotion);
+// Indexed by the low 2 bits of a promotion's flags
+const int PROMOTION_TYPES[] = {KNIGHT, BISHOP, ROOK, QUEEN};
+const std::string PROMOTION_NAMES[] = {"Knight", "Bishop", "Rook", "Queen"};
+
+int Action::promotion_type() const {
+  return PROMOTION_TYPES[flags() & 3];
 }
 
-bool operator==(const Action &lhs, const Action &rhs) {
-  // The "from" and "to" squares are sufficient to uniquely identify an action
-  return (lhs.m_piece.location == rhs.m_piece.location) && (lhs.m_space == rhs.m_space);
+castling_status_type Action::castle() const {
+  if (flags() == ACTION_CASTLE_KINGSIDE) return CASTLE_KINGSIDE;
+  if (flags() == ACTION_CASTLE_QUEENSIDE) return CASTLE_QUEENSIDE;
+  return CASTLE_NONE;
 }
 
-std::ostream &operator<<(std::ostream &os, const Action &rhs) {
-  os << rhs.m_piece.parent->type
-     << " at " << rhs.m_piece.parent->file << rhs.m_piece.parent->rank << " to ";
-  if (rhs.m_target_piece != 0)
-    os << "capture " << rhs.m_target_piece << " @ ";
-  os << char(rhs.m_space.file + 'a') << rhs.m_space.rank + 1;
-  return os;
+void Action::execute(const cpp_client::chess::Game &game) const {
+  // Convert location back from zero-indexed
+  auto file = std::string(1, 'a' + char(file_of(to())));
+  auto rank = rank_of(to()) + 1;
+  auto promotion = is_promotion() ? PROMOTION_NAMES[flags() & 3] : "";
+  for (const auto &piece : game->pieces) {
+    if (piece->rank - 1 == rank_of(from()) and piece->file[0] - 'a' == file_of(from())) {
+      piece->move(file, rank, promotion);
+      return;
+    }
+  }
+  assert(false);
 }
 
-Space operator+(const Space &lhs, const Space &rhs) {
-  return {lhs.rank + rhs.rank, lhs.file + rhs.file};
+bool Action::matches(const cpp_client::chess::Move &move) const {
+  auto promotion = is_promotion() ? PROMOTION_NAMES[flags() & 3] : "";
+  return move->from_rank - 1 == rank_of(from()) and move->from_file[0] - 'a' == file_of(from())
+      and move->to_rank - 1 == rank_of(to()) and move->to_file[0] - 'a' == file_of(to())
+      and move->promotion == promotion;
 }
 
-bool operator==(const Space &lhs, const Space &rhs) {
-  return lhs.rank == rhs.rank && lhs.file == rhs.file;
+bool operator==(const Action &lhs, const Action &rhs) {
+  return lhs.m_data == rhs.m_data;
 }
 
-PieceModel::PieceModel(cpp_client::chess::Piece piece) {
-  parent = &*piece; // The profiler showed a significant performance penalty for
-  // making several million copies of a shared pointer
-  // Because we know that this object won't be deallocated
-  // as long as we're deciding on a move and we never modify
-  // it, using an unmanaged pointer here is safe
-  type = PIECE_CODE_LOOKUP[piece->type];
-  // Convert location to 0-indexed
-  auto rank = piece->rank;
-  auto file = piece->file;
-  location = {rank - 1, file[0] - 'a'};
-}
\ No newline at end of file
+std::ostream &operator<<(std::ostream &os, const Action &rhs) {
+  // Long algebraic notation, e.g. e2e4 or e7e8q
+  os << char(file_of(rhs.from()) + 'a') << rank_of(rhs.from()) + 1
+     << char(file_of(rhs.to()) + 'a') << rank_of(rhs.to()) + 1;
+  if (rhs.is_promotion())
+    os << PIECE_CODES[6 + rhs.promotion_type()];
+  return os;
+}
@@ -16,13 +16,11 @@
 
 #include "../../../joueur/src/base_ai.hpp"
 #include "../../../joueur/src/attr_wrapper.hpp"
-#include "zobrist.hpp"
 
+#include <cstdint>
 #include <iostream>
 #include <map>
 
-class State; //Forward-declare state class to avoid circular dependencies
-
 extern std::map<std::string, char> PIECE_CODE_LOOKUP;
 
 enum castling_status_type {
@@ -32,62 +30,66 @@ enum castling_status_type {
   CASTLE_BOTH
 };
 
-// Zero-indexed way of representing rank and file
-struct Space {
-  int rank;
-  int file;
+// What kind of move an action is, stored in its top 4 bits.
+// Bit 2 marks captures and bit 3 marks promotions, with the
+// low 2 bits of a promotion picking the piece promoted to
+enum action_flags {
+  ACTION_QUIET = 0,
+  ACTION_DOUBLE_PAWN_PUSH = 1,
+  ACTION_CASTLE_KINGSIDE = 2,
+  ACTION_CASTLE_QUEENSIDE = 3,
+  ACTION_CAPTURE = 4,
+  ACTION_EN_PASSANT = 5,
+  ACTION_PROMOTE_KNIGHT = 8,
+  ACTION_PROMOTE_BISHOP = 9,
+  ACTION_PROMOTE_ROOK = 10,
+  ACTION_PROMOTE_QUEEN = 11
 };
 
-extern const Space INVALID_SPACE;
+// A move packed into 16 bits: from square (6 bits), to square (6 bits)
+// and action_flags (4 bits). Squares are rank * 8 + file, zero-indexed.
+// Everything else about the move (which piece, what it captures)
+// comes from the State it was generated from.
+class Action {
+ public:
+  Action(int from, int to, int flags = ACTION_QUIET)
+      : m_data(uint16_t(from | (to << 6) | (flags << 12))) {};
 
-Space operator+(const Space &lhs, const Space &rhs);
+  // Left uninitialized, like a built-in type, so that
+  // ActionList's storage costs nothing to construct
+  Action() = default;
 
-bool operator==(const Space &lhs, const Space &rhs);
+  int from() const { return m_data & 0x3F; }
+  int to() const { return (m_data >> 6) & 0x3F; }
+  int flags() const { return m_data >> 12; }
 
-class PieceModel {
- public:
-  PieceModel(cpp_client::chess::Piece piece);
+  bool is_capture() const { return (flags() & ACTION_CAPTURE) != 0; }
+  bool is_promotion() const { return (flags() & ACTION_PROMOTE_KNIGHT) != 0; }
 
-  PieceModel() : parent(NULL), type(0), location(INVALID_SPACE) {};
+  // The piece_type a promotion turns into
+  int promotion_type() const;
 
-  cpp_client::chess::Piece_ *parent;
-  char type; // Always an uppercase one character piece code
-  Space location;
-};
+  castling_status_type castle() const;
 
-class Action {
- public:
-  Action(PieceModel piece,
-         const State *parent,
-         Space space,
-         char target_piece = 0,
-         std::string promotion = "",
-         castling_status_type castle = CASTLE_NONE)
-      : m_piece(piece),
-        m_parent(parent),
-        m_space(space),
-        m_target_piece(target_piece),
-        m_promotion(promotion),
-        m_castle(castle) {};
-
-  Action()
-      : m_piece(), m_parent(NULL), m_space(INVALID_SPACE), m_target_piece(0), m_promotion(""), m_castle(CASTLE_NONE) {};
-  PieceModel m_piece;
-  Space m_space;
-  char m_target_piece; // 0 for none
-  std::string m_promotion;
-  castling_status_type m_castle;
-
-  void execute();
+  // Send the action to the game server. The piece is looked
+  // up by its location, so the game must be in the same
+  // position as the state the action was generated from.
+  void execute(const cpp_client::chess::Game &game) const;
+
+  // If the game's record of a move is this action
+  bool matches(const cpp_client::chess::Move &move) const;
 
   long hash() const;
 
   friend std::ostream &operator<<(std::ostream &os, const Action &rhs);
 
   friend bool operator==(const Action &lhs, const Action &rhs);
+
  private:
-  const State *m_parent;
+  uint16_t m_data;
 };
 
-#endif //CPP_CLIENT_ACTION_HPP_H
+// Placeholder for "no action". a1 to a1 is never a real move
+extern const Action NO_ACTION;
 
+#endif //CPP_CLIENT_ACTION_HPP_H
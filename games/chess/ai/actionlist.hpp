@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////
+/// @file actionlist.hpp
+/// @brief Fixed-capacity list of scored actions for move generation
+//////////////////////////////////////////////////////////////////////
+
+#ifndef CPP_CLIENT_ACTIONLIST_HPP
+#define CPP_CLIENT_ACTIONLIST_HPP
+
+#include "action.hpp"
+
+#include <cassert>
+
+struct ScoredAction {
+  Action action;
+  int score;
+};
+
+// Lives entirely on the stack. No chess position has more than
+// 218 legal moves, so the capacity is never reached.
+class ActionList {
+ public:
+  static const int CAPACITY = 256;
+
+  ActionList() : m_size(0) {};
+
+  void push_back(const Action &action) {
+    assert(m_size < CAPACITY);
+    m_entries[m_size].action = action;
+    m_entries[m_size].score = 0;
+    m_size++;
+  }
+
+  int size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+
+  const Action &operator[](int index) const { return m_entries[index].action; }
+
+  ScoredAction *begin() { return m_entries; }
+  ScoredAction *end() { return m_entries + m_size; }
+  const ScoredAction *begin() const { return m_entries; }
+  const ScoredAction *end() const { return m_entries + m_size; }
+
+  // One step of selection sort: swaps the highest scored entry at or
+  // after index into index and returns its action. Calling this for
+  // 0, 1, 2, ... walks the list best-first, and a cutoff means
+  // the rest of the list never has to be sorted at all.
+  const Action &pick_best(int index) { return pick_best(index, m_size); }
+
+  // The same, only looking at entries before end
+  const Action &pick_best(int index, int end) {
+    int best = index;
+    for (int i = index + 1; i < end; i++) {
+      if (m_entries[i].score > m_entries[best].score) best = i;
+    }
+    swap(index, best);
+    return m_entries[index].action;
+  }
+
+  void swap(int a, int b) {
+    if (a == b) return;
+    ScoredAction temp = m_entries[a];
+    m_entries[a] = m_entries[b];
+    m_entries[b] = temp;
+  }
+
+ private:
+  ScoredAction m_entries[CAPACITY];
+  int m_size;
+};
+
+#endif //CPP_CLIENT_ACTIONLIST_HPP
@@ -0,0 +1,124 @@
+//////////////////////////////////////////////////////////////////////
+/// @file actionpicker.cpp
+/// @brief Hands out a node's actions in stages, most promising first
+//////////////////////////////////////////////////////////////////////
+
+#include "actionpicker.hpp"
+
+ActionPicker::ActionPicker(const State &state,
+                           ActionList &actions,
+                           const Action tt_actions[2],
+                           const Action killers[2],
+                           const Action &countermove,
+                           const HistoryTable *history_table)
+    : m_state(state), m_actions(actions), m_tt_actions(tt_actions), m_killers(killers),
+      m_countermove(countermove), m_history_table(history_table),
+      m_stage(STAGE_TT_ACTIONS), m_stage_index(0), m_current(0),
+      m_captures_end(0), m_bad_captures_begin(0) {}
+
+Action ActionPicker::next() {
+  ScoredAction *entries = m_actions.begin();
+  int size = m_actions.size();
+
+  while (true) {
+    switch (m_stage) {
+      case STAGE_TT_ACTIONS:
+        while (m_stage_index < 2) {
+          const Action &action = m_tt_actions[m_stage_index++];
+          if (take(action, size)) return m_actions[m_current++];
+        }
+
+        // Gather the captures at the front of what's left. Bad ones are
+        // scored below zero by how much they lose, so they sort last
+        m_captures_end = m_current;
+        for (int i = m_current; i < size; i++) {
+          const Action &action = entries[i].action;
+          if (action.is_capture() or action.is_promotion()) {
+            int exchange = m_state.static_exchange_eval(action);
+            entries[i].score = exchange >= 0 ? mvv_lva(m_state, action) : exchange - 1;
+            m_actions.swap(i, m_captures_end++);
+          }
+        }
+        m_stage = STAGE_GOOD_CAPTURES;
+        break;
+
+      case STAGE_GOOD_CAPTURES:
+        if (m_current < m_captures_end) {
+          m_actions.pick_best(m_current, m_captures_end);
+          if (entries[m_current].score >= 0) return m_actions[m_current++];
+        }
+
+        // Whatever captures are left lose material. Quiets follow them
+        m_bad_captures_begin = m_current;
+        m_current = m_captures_end;
+        m_stage = STAGE_KILLERS;
+        m_stage_index = 0;
+        break;
+
+      case STAGE_KILLERS:
+        while (m_stage_index < 2) {
+          const Action &action = m_killers[m_stage_index++];
+          if (take(action, size)) return m_actions[m_current++];
+        }
+        m_stage = STAGE_COUNTERMOVE;
+        m_stage_index = 0;
+        break;
+
+      case STAGE_COUNTERMOVE:
+        if (m_stage_index++ == 0 and take(m_countermove, size)) return m_actions[m_current++];
+
+        for (int i = m_current; i < size; i++) {
+          entries[i].score = m_history_table != NULL
+              ? m_history_table->at(m_state.get_active_player(), entries[i].action) : 0;
+        }
+        m_stage = STAGE_QUIETS;
+        break;
+
+      case STAGE_QUIETS:
+        if (m_current < size) {
+          m_actions.pick_best(m_current, size);
+          return m_actions[m_current++];
+        }
+        m_current = m_bad_captures_begin;
+        m_stage = STAGE_BAD_CAPTURES;
+        break;
+
+      case STAGE_BAD_CAPTURES:
+        if (m_current < m_captures_end) {
+          m_actions.pick_best(m_current, m_captures_end);
+          return m_actions[m_current++];
+        }
+        m_stage = STAGE_DONE;
+        break;
+
+      case STAGE_DONE:
+        return NO_ACTION;
+    }
+  }
+}
+
+bool ActionPicker::take(const Action &action, int end) {
+  if (action == NO_ACTION) return false;
+  for (int i = m_current; i < end; i++) {
+    if (m_actions[i] == action) {
+      m_actions.swap(i, m_current);
+      return true;
+    }
+  }
+  return false;
+}
+
+int ActionPicker::capture_gain(const State &state, const Action &action) {
+  int gain = 0;
+  if (action.flags() == ACTION_EN_PASSANT) {
+    gain = MATERIAL_VALUE[PAWN];
+  } else if (action.is_capture()) {
+    gain = MATERIAL_VALUE[state.piece_on(action.to()) % 6];
+  }
+  if (action.is_promotion()) gain += MATERIAL_VALUE[action.promotion_type()] - MATERIAL_VALUE[PAWN];
+  return gain;
+}
+
+int ActionPicker::mvv_lva(const State &state, const Action &action) {
+  return capture_gain(state, action) * 64 - MATERIAL_VALUE[state.piece_on(action.from()) % 6];
+}
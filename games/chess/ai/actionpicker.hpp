@@ -0,0 +1,76 @@
+//////////////////////////////////////////////////////////////////////
+/// @file actionpicker.hpp
+/// @brief Hands out a node's actions in stages, most promising first
+//////////////////////////////////////////////////////////////////////
+
+#ifndef CPP_CLIENT_ACTIONPICKER_HPP
+#define CPP_CLIENT_ACTIONPICKER_HPP
+
+#include "state.hpp"
+#include "action.hpp"
+#include "actionlist.hpp"
+#include "hash.hpp"
+#include "history.hpp"
+
+enum pick_stage {
+  STAGE_TT_ACTIONS,     // Best actions from earlier searches
+  STAGE_GOOD_CAPTURES,  // Captures and promotions that don't lose material, by MVV/LVA
+  STAGE_KILLERS,        // Quiet actions that caused cutoffs at the same ply
+  STAGE_COUNTERMOVE,    // Quiet action that last refuted the previous action
+  STAGE_QUIETS,         // Everything else quiet, by history
+  STAGE_BAD_CAPTURES,   // Captures that lose material, least lost first
+  STAGE_DONE
+};
+
+// Each stage only scores and sorts what it needs, so a cutoff on an
+// early action saves the work of ordering the rest. Actions are
+// moved around within the list, but it's never added to, so every
+// action is handed out exactly once.
+class ActionPicker {
+ public:
+  // @param actions : every action to hand out. Reordered in place
+  // @param tt_actions : two actions to try first, or NO_ACTION
+  // @param killers : two quiet actions to try after good captures, or NO_ACTION
+  // @param history_table : scores quiet actions. NULL leaves them unordered
+  ActionPicker(const State &state,
+               ActionList &actions,
+               const Action tt_actions[2],
+               const Action killers[2],
+               const Action &countermove,
+               const HistoryTable *history_table);
+
+  // @return the next action, or NO_ACTION when they've all been handed out
+  Action next();
+
+  // The stage the last action from next() came from
+  pick_stage stage() const { return m_stage; }
+
+  // Material an action wins outright, counting promotions
+  static int capture_gain(const State &state, const Action &action);
+
+  // Most valuable victim first, least valuable attacker breaking ties
+  static int mvv_lva(const State &state, const Action &action);
+
+ private:
+  // Moves action to m_current if it hasn't been handed out yet
+  // @return true if it was found
+  bool take(const Action &action, int end);
+
+  const State &m_state;
+  ActionList &m_actions;
+  const Action *m_tt_actions;
+  const Action *m_killers;
+  Action m_countermove;
+  const HistoryTable *m_history_table;
+
+  pick_stage m_stage;
+  int m_stage_index;  // Progress through the stage's candidate actions
+  int m_current;      // Everything before this has been handed out
+
+  // Captures are moved to the front of what's left, bad ones being
+  // put off until after the quiets
+  int m_captures_end;
+  int m_bad_captures_begin;
+};
+
+#endif //CPP_CLIENT_ACTIONPICKER_HPP
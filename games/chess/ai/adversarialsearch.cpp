@@ -3,200 +3,369 @@
 //
 
 #include <algorithm>
+#include <cmath>
 #include "adversarialsearch.hpp"
 
-#define INT_INFINITY INT32_MAX //Ehh, close enough
+// Far from overflowing when negated or widened by one
+const int INT_INFINITY = 1000000000;
 
-using tuple = std::pair<int, int>;
-const int CHECKMATE_BASE_VAL = INT_INFINITY - 50; // Give some wiggle room for delay prevention
+// Mate in n plies scores CHECKMATE_VAL - n, so sooner mates score higher.
+// Anything past MATE_BOUND is a mate score
+const int CHECKMATE_VAL = INT_INFINITY - 1000;
+const int MATE_BOUND = CHECKMATE_VAL - MAX_PLY;
 
-Action AdversarialSearch::depth_limited_minimax_search(const State &state, int depth_limit, int quiescence_limit) {
-  int active_player = state.get_active_player();
-  auto actions = state.available_actions(active_player);
-  actions = history_table_sort(actions);
-  assert(actions.size() > 0);
-  std::vector<int> scores(actions.size());
+// Positional swing a capture might bring on top of the material
+// it wins, for delta pruning in the quiescence search
+const int DELTA_MARGIN = 2 * MATERIAL_VALUE[PAWN];
+
+// History scores are halved once one passes this, so they never overflow
+const int HISTORY_LIMIT = 1 << 24;
+
+// Null move pruning is tried from NULL_MOVE_MIN_DEPTH, reducing the
+// depth by 3 instead of 2 past NULL_MOVE_DEEP_DEPTH. From
+// NULL_MOVE_VERIFICATION_DEPTH a cutoff has to be confirmed
+const int NULL_MOVE_MIN_DEPTH = 3;
+const int NULL_MOVE_DEEP_DEPTH = 6;
+const int NULL_MOVE_VERIFICATION_DEPTH = 8;
+
+// Half the width of the first aspiration window, which doubles
+// every time the score falls outside it. Past the maximum
+// the window opens all the way on that side
+const int ASPIRATION_WINDOW = MATERIAL_VALUE[PAWN] / 2;
+const int MAX_ASPIRATION_WINDOW = 8 * MATERIAL_VALUE[PAWN];
+const int ASPIRATION_MIN_DEPTH = 4;
+
+// The clock is checked every CLOCK_CHECK_MASK + 1 nodes
+const uint64_t CLOCK_CHECK_MASK = 4095;
+
+// Indexed by depth and how many actions have been searched, both capped at 63
+int LATE_MOVE_REDUCTIONS[64][64];
+
+// Late move reductions start after this many actions, from this depth
+const int LMR_MIN_SEARCHED = 3;
+const int LMR_MIN_DEPTH = 3;
+
+void init_late_move_reductions(int base, int divisor) {
+  for (int depth = 0; depth < 64; depth++) {
+    for (int searched = 0; searched < 64; searched++) {
+      double reduction = 0;
+      if (divisor > 0 and depth > 0 and searched > 0) {
+        reduction = base / 100.0 + std::log(depth) * std::log(searched) / (divisor / 100.0);
+      }
+      LATE_MOVE_REDUCTIONS[depth][searched] = std::max(0, int(reduction));
+    }
+  }
+}
+
+// If a stored search result already settles this node's value
+// for the current window, there's no need to search it again
+static bool tt_cutoff(const TTEntry &entry, int alpha, int beta) {
+  return entry.bound == BOUND_EXACT
+      or (entry.bound == BOUND_LOWER and entry.score >= beta)
+      or (entry.bound == BOUND_UPPER and entry.score <= alpha);
+}
+
+// Mate scores count plies from the root, but the table is shared between
+// searches from different roots, so they're stored counting from the node
+static int score_to_tt(int score, int ply) {
+  if (score >= MATE_BOUND) return score + ply;
+  if (score <= -MATE_BOUND) return score - ply;
+  return score;
+}
+
+static int score_from_tt(int score, int ply) {
+  if (score >= MATE_BOUND) return score - ply;
+  if (score <= -MATE_BOUND) return score + ply;
+  return score;
+}
+
+Action AdversarialSearch::depth_limited_minimax_search(const State &root, int depth_limit) {
+  // The one copy of the state the whole search works on
+  State state = root;
+  m_max_player = state.get_active_player();
+  m_failed_low = false;
+
+  // Aspiration windows. The score usually doesn't move far between
+  // depths, and a narrow window around the last one cuts off more.
+  // If the score lands outside it, widen that side and search again
   int alpha = -INT_INFINITY;
   int beta = INT_INFINITY;
+  int window = ASPIRATION_WINDOW;
+  bool aspirate = depth_limit >= ASPIRATION_MIN_DEPTH and m_previous_pv_length > 0
+      and m_score > -MATE_BOUND and m_score < MATE_BOUND;
+  if (aspirate) {
+    alpha = std::max(m_score - window, -INT_INFINITY);
+    beta = std::min(m_score + window, INT_INFINITY);
+  }
+
+  int score;
+  while (true) {
+    m_follow_pv = m_previous_pv_length > 0;
+    score = principal_variation_search(state, depth_limit, alpha, beta, 0);
+    if (stopped()) break;
 
-  for (int i = 0; i < actions.size(); i++) {
-    scores[i] = dlmm_minv(state.apply(actions[i]),
-                          active_player,
-                          depth_limit - 1,
-                          quiescence_limit,
-                          alpha,
-                          beta);
-    if (scores[i] > alpha) {
-      alpha = scores[i];
+    window = window * 2 > MAX_ASPIRATION_WINDOW ? INT_INFINITY : window * 2;
+    if (score <= alpha) {
+      m_failed_low = true;
+      alpha = std::max(score - window, -INT_INFINITY);
+    } else if (score >= beta) {
+      beta = std::min(score + window, INT_INFINITY);
+    } else {
+      break;
     }
   }
 
-  bool action_picked = false;
-  int best_action_score = -INT_INFINITY, best_action_index = 0;
-  for (int i = 0; i < scores.size(); i++) {
-    if ((scores[i] > best_action_score)
-        or ((scores[i] == best_action_score)
-            && (random() % 2 == 0))) {
-      best_action_score = scores[i];
-      best_action_index = i;
-      action_picked = true;
-    }
-    //assert(best_action_score != -INT_INFINITY);
-    // If there's a tie, 50% chance of replacement
-    // Statistically, this implementation might favor later
-    // generated actions instead of being completely fair.
-    // TODO: Check this out.
-  }
-  history_table_update(actions[best_action_index]);
-  //assert(action_picked); This was triggering when checkmate was assured, so temporarily disabled
-  return (actions[best_action_index]);
+  if (stopped() or m_pv_length[0] == 0) {
+    // Fall back on the last complete search, or any legal action
+    if (m_previous_pv_length > 0) return m_previous_pv[0];
+    auto actions = state.available_actions(state.get_active_player());
+    assert(actions.size() > 0);
+    return actions[0];
+  }
+
+  m_score = score;
+  m_previous_pv_length = m_pv_length[0];
+  for (int i = 0; i < m_previous_pv_length; i++) {
+    m_previous_pv[i] = m_pv[0][i];
+  }
+  return m_pv[0][0];
 }
 
-int AdversarialSearch::dlmm_minv(const State &state,
-                                 int max_player_id,
-                                 int depth_limit,
-                                 int quiescence_limit,
-                                 int alpha,
-                                 int beta) {
-  assert(state.get_active_player() != max_player_id);
-  bool quiescent_search = false;
-
-  if (depth_limit <= 0) {
-    if (quiescence_limit > 0 && state.is_non_quiescent()) {
-      quiescent_search = true;
-    } else {
-      return transposition_table_heuristic(state, max_player_id);
+int AdversarialSearch::principal_variation_search(State &state,
+                                                  int depth_limit,
+                                                  int alpha,
+                                                  int beta,
+                                                  int ply,
+                                                  bool allow_null) {
+  if (depth_limit <= 0) return quiescence_search(state, alpha, beta, ply);
+  m_pv_length[ply] = ply;
+  count_node();
+  if (stopped()) return 0;
+  if (ply >= MAX_PLY - 1) return cached_heuristic(state);
+
+  // Only nodes searched with a full window can be on the principal
+  // variation. Everything else just has to prove it's no better
+  bool pv_node = beta - alpha > 1;
+
+  // Look up what earlier searches found here. Principal
+  // variation nodes search anyway, so the line stays whole
+  uint64_t key = state.hash();
+  TTEntry entry;
+  Action tt_action = NO_ACTION;
+  if (m_transposition_table->probe(key, entry)) {
+    tt_action = entry.best_action;
+    entry.score = score_from_tt(entry.score, ply);
+    if (!pv_node and entry.depth >= depth_limit and tt_cutoff(entry, alpha, beta)) return entry.score;
+  }
+  int original_alpha = alpha;
+  int active_player = state.get_active_player();
+  bool in_check = state.in_check(active_player);
+
+  // Null move pruning. If passing the turn and searching shallower
+  // still fails high, a real action almost certainly would too.
+  // Passing is only ever worse when every action is bad, which is
+  // likely with just pawns left. Deep down a failed high null move
+  // is checked with a normal search to catch that anyway
+  if (allow_null and !pv_node and !in_check and depth_limit >= NULL_MOVE_MIN_DEPTH
+      and state.has_non_pawn_material(active_player)
+      and cached_heuristic(state) >= beta) {
+    int reduction = depth_limit > NULL_MOVE_DEEP_DEPTH ? 3 : 2;
+    auto undo = state.make_null();
+    int score = -principal_variation_search(state, depth_limit - 1 - reduction, -beta, -beta + 1, ply + 1, false);
+    state.unmake_null(undo);
+    if (stopped()) return 0;
+
+    if (score >= beta) {
+      // A mate found after passing isn't a real mate
+      if (score >= MATE_BOUND) score = beta;
+      if (depth_limit < NULL_MOVE_VERIFICATION_DEPTH) return score;
+
+      // The verification searches this same node, so it
+      // mustn't leave its line behind if it fails
+      int pv_length = m_pv_length[ply];
+      int verified = principal_variation_search(state, depth_limit - reduction, beta - 1, beta, ply, false);
+      m_pv_length[ply] = pv_length;
+      if (stopped()) return 0;
+      if (verified >= beta) return score;
     }
   }
 
-  auto actions = state.available_actions(state.get_active_player());
-  actions = history_table_sort(actions);
-  // Check for terminal state
+  auto actions = state.available_actions(active_player);
   if (actions.size() <= 0) {
-    int remaining_depth = depth_limit + quiescence_limit;
-    return CHECKMATE_BASE_VAL + remaining_depth; // CHECKMATE! Victory. Earlier checkmates are better, so prefer those
+    // Checkmate, or stalemate if the player to move isn't in check
+    return in_check ? -(CHECKMATE_VAL - ply) : 0;
+  }
+
+  // Follow the last search's principal variation as long as this node is on it
+  Action pv_action = NO_ACTION;
+  if (m_follow_pv) {
+    if (ply < m_previous_pv_length) {
+      pv_action = m_previous_pv[ply];
+    } else {
+      m_follow_pv = false;
+    }
   }
-  int best_action_score = INT_INFINITY, best_action_index = 0; //Trying to minimize, so start out with +inf and reduce
-  for (int i = 0; i < actions.size(); i++) {
+  const Action tt_actions[2] = {pv_action, tt_action};
+  ActionPicker picker(state, actions, tt_actions, m_killers[ply], countermove(state), m_history_table);
+
+  int best_action_score = -INT_INFINITY;
+  Action best_action = NO_ACTION;
+  int searched = 0;
+  for (Action action = picker.next(); !(action == NO_ACTION); action = picker.next()) {
+    if (!(action == pv_action)) m_follow_pv = false;
+
     int score;
-    if (quiescent_search) {
-      score = dlmm_maxv(state.apply(actions[i]), max_player_id, depth_limit, quiescence_limit - 1, alpha, beta);
+    auto undo = state.make(action);
+    if (searched++ == 0) {
+      score = -principal_variation_search(state, depth_limit - 1, -beta, -alpha, ply + 1);
     } else {
-      score = dlmm_maxv(state.apply(actions[i]), max_player_id, depth_limit - 1, quiescence_limit, alpha, beta);
+      // Late move reductions. Ordering puts the best actions first, so
+      // quiet ones this far down probably aren't worth a full search
+      // unless a shallower one says otherwise. Checks aren't reduced
+      int reduction = 0;
+      if (searched > LMR_MIN_SEARCHED and depth_limit >= LMR_MIN_DEPTH and !in_check
+          and picker.stage() == STAGE_QUIETS and !state.in_check(state.get_active_player())) {
+        reduction = LATE_MOVE_REDUCTIONS[std::min(depth_limit, 63)][std::min(searched, 63)];
+        if (pv_node) reduction--;
+        reduction = std::max(0, std::min(reduction, depth_limit - 2));
+      }
+
+      score = -principal_variation_search(state, depth_limit - 1 - reduction, -alpha - 1, -alpha, ply + 1);
+      if (reduction > 0 and score > alpha) {
+        score = -principal_variation_search(state, depth_limit - 1, -alpha - 1, -alpha, ply + 1);
+      }
+      if (score > alpha and score < beta) {
+        score = -principal_variation_search(state, depth_limit - 1, -beta, -alpha, ply + 1);
+      }
     }
+    state.unmake(action, undo);
+    if (stopped()) return 0;
 
-    // Check for a fail-low
-    if (score <= alpha) {
-      history_table_update(actions[i]);
-      return score;
+    if (score > best_action_score) {
+      best_action_score = score;
+      best_action = action;
     }
-    if (score < beta) {
-      beta = score;
+    if (score > alpha) {
+      alpha = score;
+
+      // This action's line is the best so far
+      update_pv(action, ply);
     }
-    if ((score < best_action_score)
-        or ((score == best_action_score)
-            && (random() % 2 == 0))) {
-      best_action_score = score;
-      best_action_index = i;
+
+    // Check for fail-high
+    if (score >= beta) {
+      if (!action.is_capture() and !action.is_promotion()) {
+        update_killers(state, action, ply);
+        history_table_update(active_player, action, depth_limit);
+      }
+      break;
     }
-    //assert(best_action_score < INT_INFINITY);
   }
-  history_table_update(actions[best_action_index]);
+
+  bound_type bound = best_action_score >= beta ? BOUND_LOWER
+                   : best_action_score > original_alpha ? BOUND_EXACT : BOUND_UPPER;
+  m_transposition_table->store(key, score_to_tt(best_action_score, ply), depth_limit, bound, best_action);
   return best_action_score;
 }
 
-int AdversarialSearch::dlmm_maxv(const State &state,
-                                 int max_player_id,
-                                 int depth_limit,
-                                 int quiescence_limit,
-                                 int alpha,
-                                 int beta) {
-  assert(state.get_active_player() == max_player_id);
-  bool quiescent_search = false;
-
-  if (depth_limit <= 0) {
-    if (quiescence_limit > 0 && state.is_non_quiescent()) {
-      quiescent_search = true;
-    } else {
-      return transposition_table_heuristic(state, max_player_id);
-    }
-  }
+int AdversarialSearch::quiescence_search(State &state, int alpha, int beta, int ply) {
+  m_pv_length[ply] = ply;
+  count_node();
+  if (stopped()) return 0;
+  if (ply >= MAX_PLY - 1) return cached_heuristic(state);
 
-  auto actions = state.available_actions(state.get_active_player());
-  actions = history_table_sort(actions);
-  if (actions.size() <= 0) {
-    return -INT_INFINITY; // CHECKMATE! Loss.
+  // In check every evasion has to be looked at, since standing
+  // pat on a position that might be checkmate proves nothing
+  int active_player = state.get_active_player();
+  bool in_check = state.in_check(active_player);
+  int stand_pat = -INT_INFINITY;
+  if (!in_check) {
+    stand_pat = cached_heuristic(state);
+    if (stand_pat >= beta) return stand_pat;
+    if (stand_pat > alpha) alpha = stand_pat;
   }
+  auto actions = in_check ? state.available_actions(active_player) : state.available_captures(active_player);
+  if (in_check and actions.size() <= 0) return -(CHECKMATE_VAL - ply);
+  const Action no_actions[2] = {NO_ACTION, NO_ACTION};
+  ActionPicker picker(state, actions, no_actions, no_actions, NO_ACTION, m_history_table);
 
-  int best_action_score = -INT_INFINITY, best_action_index = 0;
-  for (int i = 0; i < actions.size(); i++) {
-    int score;
-    if (quiescent_search) {
-      score = dlmm_minv(state.apply(actions[i]), max_player_id, depth_limit, quiescence_limit - 1, alpha, beta);
-    } else {
-      score = dlmm_minv(state.apply(actions[i]), max_player_id, depth_limit - 1, quiescence_limit, alpha, beta);
+  int best_action_score = stand_pat;
+  for (Action action = picker.next(); !(action == NO_ACTION); action = picker.next()) {
+    if (!in_check) {
+      // Captures that lose material once the exchange plays out aren't worth it
+      if (picker.stage() == STAGE_BAD_CAPTURES) break;
+
+      // Delta pruning. Skip captures that couldn't bring the
+      // score back up to alpha even if the piece came for free
+      if (stand_pat + ActionPicker::capture_gain(state, action) + DELTA_MARGIN <= alpha) continue;
     }
 
-    // Check for fail-high
-    if (score >= beta) {
-      history_table_update(actions[i]);
-      return score;
+    auto undo = state.make(action);
+    int score = -quiescence_search(state, -beta, -alpha, ply + 1);
+    state.unmake(action, undo);
+    if (stopped()) return 0;
+
+    if (score > best_action_score) {
+      best_action_score = score;
     }
     if (score > alpha) {
       alpha = score;
+      update_pv(action, ply);
     }
-    if ((score > best_action_score)
-        or ((score == best_action_score)
-            && (random() % 2 == 0))) {
-      best_action_score = score;
-      best_action_index = i;
+    if (score >= beta) {
+      break;
     }
-    //assert(best_action_score > -INT_INFINITY);
   }
-  history_table_update(actions[best_action_index]);
   return best_action_score;
 }
 
-std::vector<Action> AdversarialSearch::history_table_sort(const std::vector<Action> &actions) const {
-  // tuples contain <occurrence frequency, action index>
-  // We load the frequency in, then sort them together
-  std::vector<tuple> scores(actions.size());
-  std::vector<Action> results(actions.size());
-  for (int i = 0; i < actions.size(); i++) {
-    scores[i].second = i;
-    auto it = m_history_table->find(actions[i]);
-    if (it != m_history_table->end()) {
-      scores[i].first = it->second; //Load the
-    } else {
-      scores[i].first = 0;
-    }
+void AdversarialSearch::count_node() {
+  m_nodes++;
+  if ((m_nodes & CLOCK_CHECK_MASK) == 0 and m_time_manager != NULL and m_time_manager->hard_limit_reached()) {
+    m_out_of_time = true;
   }
+}
 
-  std::sort(scores.rbegin(), scores.rend());
-
-  for (int i = 0; i < actions.size(); i++) {
-    results[i] = actions[scores[i].second];
+void AdversarialSearch::update_pv(const Action &action, int ply) {
+  m_pv[ply][ply] = action;
+  for (int i = ply + 1; i < m_pv_length[ply + 1]; i++) {
+    m_pv[ply][i] = m_pv[ply + 1][i];
   }
-  return results;
+  m_pv_length[ply] = m_pv_length[ply + 1];
 }
 
-void AdversarialSearch::history_table_update(const Action &action) {
-  auto it = m_history_table->find(action);
-  if (it != m_history_table->end()) {
-    it->second++;
-  } else {
-    m_history_table->insert(std::make_pair(action, 1));
+Action AdversarialSearch::countermove(const State &state) const {
+  int last_move = state.get_last_move();
+  if (last_move == NO_SQUARE or state.piece_on(last_move) == NO_PIECE) return NO_ACTION;
+  return m_countermoves[state.piece_on(last_move)][last_move];
+}
+
+void AdversarialSearch::update_killers(const State &state, const Action &action, int ply) {
+  if (!(m_killers[ply][0] == action)) {
+    m_killers[ply][1] = m_killers[ply][0];
+    m_killers[ply][0] = action;
+  }
+  int last_move = state.get_last_move();
+  if (last_move != NO_SQUARE and state.piece_on(last_move) != NO_PIECE) {
+    m_countermoves[state.piece_on(last_move)][last_move] = action;
   }
 }
 
-int AdversarialSearch::transposition_table_heuristic(const State &state, int max_player_id) {
+void AdversarialSearch::history_table_update(int side, const Action &action, int depth) {
+  // Cutoffs near the root prune far more of the tree
+  int &score = m_history_table->at(side, action);
+  score += depth * depth;
+  if (score > HISTORY_LIMIT) m_history_table->age();
+}
 
-  auto it = m_transposition_table->find(state.hash());
-  if (it != m_transposition_table->end()) {
-    return it->second;
-  } else {
-    int heuristic_val = state.heuristic_eval(max_player_id);
-    m_transposition_table->insert(std::make_pair(state.hash(), heuristic_val));
-    return heuristic_val;
+int AdversarialSearch::cached_heuristic(const State &state) {
+  // The eval is from the max player's side, so that's part of the key
+  uint64_t key = state.hash() ^ EVAL_PERSPECTIVE_KEY[m_max_player];
+  int heuristic_val;
+  if (not m_eval_cache->probe(key, heuristic_val)) {
+    heuristic_val = state.heuristic_eval(m_max_player);
+    m_eval_cache->store(key, heuristic_val);
   }
-}
\ No newline at end of file
+  if (state.get_active_player() != m_max_player) heuristic_val = -heuristic_val;
+  return heuristic_val;
+}
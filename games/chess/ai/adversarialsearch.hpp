@@ -4,36 +4,147 @@
 #include "state.hpp"
 #include "action.hpp"
 #include "hash.hpp"
+#include "history.hpp"
+#include "transposition.hpp"
+#include "evalcache.hpp"
+#include "actionpicker.hpp"
+#include "timemanager.hpp"
+
+#include <atomic>
 
 using move_val_pair = std::tuple<Action, int>;
 
+// Deepest the search can go, counting quiescence
+const int MAX_PLY = 128;
+
+// Fill the late move reduction table. Quiet actions late in the
+// ordering are searched base + ln(depth) * ln(actions searched) / divisor
+// plies shallower. Both are in hundredths, and a divisor of 0 turns
+// reductions off. Call once before searching
+void init_late_move_reductions(int base, int divisor);
+
 class AdversarialSearch {
  public:
-  AdversarialSearch(std::unordered_map<Action, int> *history_table, std::unordered_map<long, int> *transposition_table)
-      : m_history_table(history_table), m_transposition_table(transposition_table) {};
+  // @param stop : if given, the search gives up as soon as it's set.
+  //                The result of an abandoned search is meaningless
+  //                and nothing from it is stored in the tables
+  // @param time_manager : if given, the search gives up once its
+  //                       hard limit is reached, the same as being stopped
+  AdversarialSearch(HistoryTable *history_table,
+                    TranspositionTable *transposition_table,
+                    EvalCache *eval_cache,
+                    const std::atomic<bool> *stop = NULL,
+                    const TimeManager *time_manager = NULL)
+      : m_history_table(history_table), m_transposition_table(transposition_table),
+        m_eval_cache(eval_cache), m_stop(stop),
+        m_time_manager(time_manager), m_nodes(0), m_out_of_time(false), m_score(0), m_failed_low(false),
+        m_max_player(0), m_previous_pv_length(0), m_follow_pv(false) {
+    for (auto &killers : m_killers) killers[0] = killers[1] = NO_ACTION;
+    for (auto &countermoves : m_countermoves) {
+      for (auto &countermove : countermoves) countermove = NO_ACTION;
+    }
+  };
 
   // Returns the best action for the active player
-  Action depth_limited_minimax_search(const State &state, int depth_limit, int quiescence_limit);
+  //
+  // Call with increasing depth limits on the same state: each
+  // search tries the previous one's principal variation first.
+  // If the search is stopped or runs out of time, the last
+  // completed search's best action is returned instead
+  Action depth_limited_minimax_search(const State &state, int depth_limit);
+
+  // If the last search was abandoned before it finished
+  bool aborted() const { return stopped(); }
+
+  // Value of the root for the player to move, from the last completed search
+  int get_score() const { return m_score; }
 
-  // Find the value of the objective function
-  // if min player takes the move here that is worst for max player
+  // If the last search's aspiration window had to be widened because
+  // the score came in below it, meaning the best action got worse
+  bool failed_low() const { return m_failed_low; }
+
+  // The last completed search's principal variation,
+  // starting with the action it returned
+  int get_pv_length() const { return m_previous_pv_length; }
+  const Action &get_pv(int ply) const { return m_previous_pv[ply]; }
+
+  // Negamax alpha-beta search with principal variation search.
+  // The first action gets the full window, the rest get a null window
+  // to prove they're no better, and are only re-searched with the
+  // full window if that fails.
+  //
+  // @return value of the state for the player to move, within [alpha, beta]
+  //         unless the search failed high or low
   //
-  // @pre only called on min player's turn
+  // Actions are made and unmade on state in place, so it
+  // is back in its original position when this returns
   //
-  // keeping track of the max player's ID is necessary to
-  // know who to calculate the state eval function for.
-  int dlmm_minv(const State &state, int max_player_id, int depth_limit, int quiescence_limit, int alpha, int beta);
+  // @param allow_null : if null move pruning may be tried here.
+  //                     Never twice in a row
+  int principal_variation_search(State &state, int depth_limit, int alpha, int beta, int ply,
+                                 bool allow_null = true);
 
-  // Find the move for max player that maximizes objective function
+  // Searches captures and promotions past the depth limit until the
+  // position is quiet, so the heuristic isn't run in the middle of
+  // an exchange. The player to move can stand pat on the heuristic
+  // instead of capturing, unless they're in check.
   //
-  // @pre only called on max player's turn
-  int dlmm_maxv(const State &state, int max_player_id, int depth_limit, int quiescence_limit, int alpha, int beta);
+  // @return value of the state for the player to move, like principal_variation_search
+  int quiescence_search(State &state, int alpha, int beta, int ply);
  private:
-  std::unordered_map<Action, int> *m_history_table;
-  std::unordered_map<long, int> *m_transposition_table;
-  std::vector<Action> history_table_sort(const std::vector<Action> &actions) const;
-  int transposition_table_heuristic(const State& state, int max_player_id);
-  void history_table_update(const Action &action);
+  HistoryTable *m_history_table;
+  TranspositionTable *m_transposition_table;
+  EvalCache *m_eval_cache;
+  const std::atomic<bool> *m_stop;
+  const TimeManager *m_time_manager;
+  bool stopped() const { return m_out_of_time or (m_stop != NULL and m_stop->load(std::memory_order_relaxed)); }
+
+  // Reading the clock is slow next to searching a node,
+  // so it's only checked every few thousand nodes
+  void count_node();
+  uint64_t m_nodes;
+  bool m_out_of_time;
+
+  int m_score;
+  bool m_failed_low;
+
+  // The heuristic is from this player's point of view, so
+  // it's negated when evaluating for the other player
+  int m_max_player;
+
+  // Triangular array. m_pv[ply] holds the best line found from ply
+  // onwards, from m_pv[ply][ply] up to m_pv[ply][m_pv_length[ply] - 1]
+  Action m_pv[MAX_PLY][MAX_PLY];
+  int m_pv_length[MAX_PLY];
+
+  // The last completed search's principal variation, searched
+  // first by the next one while m_follow_pv is set
+  Action m_previous_pv[MAX_PLY];
+  int m_previous_pv_length;
+  bool m_follow_pv;
+
+  // Makes action followed by the line at ply + 1 the line at ply
+  void update_pv(const Action &action, int ply);
+
+  // Quiet actions that caused a cutoff at each ply, most recent first.
+  // Sibling positions tend to be refuted by the same action
+  Action m_killers[MAX_PLY][2];
+
+  // The quiet action that last refuted each action,
+  // indexed by the piece it moved and where to
+  Action m_countermoves[NO_PIECE][64];
+
+  // The countermove stored for the action that led to state
+  Action countermove(const State &state) const;
+
+  // Remember a quiet action that caused a cutoff
+  void update_killers(const State &state, const Action &action, int ply);
+
+  // Static evaluation for the player to move, cached in the eval cache
+  int cached_heuristic(const State& state);
+
+  // Reward a quiet action that caused a cutoff at depth
+  void history_table_update(int side, const Action &action, int depth);
 };
 
 #endif //CPP_CLIENT_DEPTH_LIMITED_MINIMAX_HPP
@@ -0,0 +1,166 @@
+//////////////////////////////////////////////////////////////////////
+/// @file bitboard.cpp
+/// @brief Bitboard primitives and precomputed attack tables
+//////////////////////////////////////////////////////////////////////
+
+#include "bitboard.hpp"
+
+const char PIECE_CODES[] = "PRNBQKprnbqk";
+
+Bitboard KNIGHT_ATTACKS[64];
+Bitboard KING_ATTACKS[64];
+Bitboard PAWN_ATTACKS[2][64];
+Bitboard BETWEEN[64][64];
+Bitboard LINE[64][64];
+
+bool USE_PEXT = false;
+bool USE_POPCNT = false;
+Magic ROOK_MAGICS[64];
+Magic BISHOP_MAGICS[64];
+
+// Every square's attack sets for every blocker configuration, packed together.
+// Sizes are the sum of 2^(relevant blocker count) over all squares
+static Bitboard ROOK_TABLE[0x19000];
+static Bitboard BISHOP_TABLE[0x1480];
+
+// Walks a ray from the square in the direction given by the shift function
+// until it falls off the board or hits an occupied square
+static Bitboard ray_attacks(int square, Bitboard occupied, Bitboard (*step)(Bitboard)) {
+  Bitboard attacks = 0;
+  Bitboard ray = step(square_bb(square));
+  while (ray) {
+    attacks |= ray;
+    if (ray & occupied) break;
+    ray = step(ray);
+  }
+  return attacks;
+}
+
+static Bitboard shift_north_east(Bitboard b) { return shift_north(shift_east(b)); }
+static Bitboard shift_north_west(Bitboard b) { return shift_north(shift_west(b)); }
+static Bitboard shift_south_east(Bitboard b) { return shift_south(shift_east(b)); }
+static Bitboard shift_south_west(Bitboard b) { return shift_south(shift_west(b)); }
+
+static Bitboard slow_rook_attacks(int square, Bitboard occupied) {
+  return ray_attacks(square, occupied, shift_north)
+      | ray_attacks(square, occupied, shift_south)
+      | ray_attacks(square, occupied, shift_east)
+      | ray_attacks(square, occupied, shift_west);
+}
+
+static Bitboard slow_bishop_attacks(int square, Bitboard occupied) {
+  return ray_attacks(square, occupied, shift_north_east)
+      | ray_attacks(square, occupied, shift_north_west)
+      | ray_attacks(square, occupied, shift_south_east)
+      | ray_attacks(square, occupied, shift_south_west);
+}
+
+// xorshift64* generator for magic candidates.
+// Fixed seed, so startup always finds the same magics
+static Bitboard magic_random(Bitboard &seed) {
+  seed ^= seed >> 12;
+  seed ^= seed << 25;
+  seed ^= seed >> 27;
+  return seed * 2685821657736338717ULL;
+}
+
+// Fills in the magics and attack table for one slider type
+static void init_magics(Magic magics[], Bitboard table[],
+                        Bitboard (*slow_attacks)(int, Bitboard)) {
+  Bitboard occupancy[4096], reference[4096];
+  int epoch[4096] = {}, attempt = 0;
+  Bitboard seed = 0x9E3779B97F4A7C15ULL;
+  Bitboard *next_table = table;
+
+  for (int square = 0; square < 64; square++) {
+    Magic &m = magics[square];
+
+    // Pieces on the board edge never block anything further along the ray
+    Bitboard rank_edges = (RANK_1 | RANK_8) & ~(RANK_1 << (8 * rank_of(square)));
+    Bitboard file_edges = (FILE_A | FILE_H) & ~(FILE_A << file_of(square));
+    m.mask = slow_attacks(square, 0) & ~(rank_edges | file_edges);
+    m.shift = 64 - popcount(m.mask);
+    m.attacks = next_table;
+
+    // Enumerate every subset of the mask (Carry-Rippler trick)
+    int size = 0;
+    Bitboard b = 0;
+    do {
+      occupancy[size] = b;
+      reference[size] = slow_attacks(square, b);
+      size++;
+      b = (b - m.mask) & m.mask;
+    } while (b);
+    next_table += size;
+
+#ifdef CPP_CLIENT_HAS_PEXT
+    if (USE_PEXT) {
+      m.magic = 0;
+      for (int i = 0; i < size; i++) {
+        m.attacks[pext(occupancy[i], m.mask)] = reference[i];
+      }
+      continue;
+    }
+#endif
+
+    // Try sparse random numbers until one maps every occupancy to
+    // an index that doesn't collide with a different attack set
+    bool found = false;
+    while (!found) {
+      m.magic = magic_random(seed) & magic_random(seed) & magic_random(seed);
+      if (popcount((m.mask * m.magic) >> 56) < 6) continue;
+      attempt++;
+      found = true;
+      for (int i = 0; i < size; i++) {
+        unsigned index = m.index(occupancy[i]);
+        if (epoch[index] < attempt) {
+          epoch[index] = attempt;
+          m.attacks[index] = reference[i];
+        } else if (m.attacks[index] != reference[i]) {
+          found = false;
+          break;
+        }
+      }
+    }
+  }
+}
+
+void init_bitboards() {
+#ifdef CPP_CLIENT_HAS_PEXT
+  USE_PEXT = __builtin_cpu_supports("bmi2");
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+  USE_POPCNT = __builtin_cpu_supports("popcnt");
+#endif
+  init_magics(ROOK_MAGICS, ROOK_TABLE, slow_rook_attacks);
+  init_magics(BISHOP_MAGICS, BISHOP_TABLE, slow_bishop_attacks);
+
+  for (int square = 0; square < 64; square++) {
+    Bitboard b = square_bb(square);
+
+    Bitboard l1 = shift_west(b), r1 = shift_east(b);
+    Bitboard l2 = shift_west(l1), r2 = shift_east(r1);
+    Bitboard h1 = l1 | r1, h2 = l2 | r2;
+    KNIGHT_ATTACKS[square] = (h1 << 16) | (h1 >> 16) | (h2 << 8) | (h2 >> 8);
+
+    Bitboard row = b | h1;
+    KING_ATTACKS[square] = (row | shift_north(row) | shift_south(row)) & ~b;
+
+    PAWN_ATTACKS[0][square] = shift_north(h1);
+    PAWN_ATTACKS[1][square] = shift_south(h1);
+  }
+
+  for (int a = 0; a < 64; a++) {
+    for (int b = 0; b < 64; b++) {
+      Bitboard ab = square_bb(a) | square_bb(b);
+      if (a == b) continue;
+      if (rook_attacks(a, 0) & square_bb(b)) {
+        LINE[a][b] = (rook_attacks(a, 0) & rook_attacks(b, 0)) | ab;
+        BETWEEN[a][b] = rook_attacks(a, ab) & rook_attacks(b, ab);
+      } else if (bishop_attacks(a, 0) & square_bb(b)) {
+        LINE[a][b] = (bishop_attacks(a, 0) & bishop_attacks(b, 0)) | ab;
+        BETWEEN[a][b] = bishop_attacks(a, ab) & bishop_attacks(b, ab);
+      }
+    }
+  }
+}
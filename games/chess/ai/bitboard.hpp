@@ -0,0 +1,150 @@
+//////////////////////////////////////////////////////////////////////
+/// @file bitboard.hpp
+/// @brief Bitboard primitives and precomputed attack tables
+//////////////////////////////////////////////////////////////////////
+
+#ifndef CPP_CLIENT_BITBOARD_HPP
+#define CPP_CLIENT_BITBOARD_HPP
+
+#include <cstdint>
+
+// One bit per square. Bit 0 is a1, bit 7 is h1, bit 63 is h8,
+// so a square's index is rank * 8 + file (both zero-indexed)
+typedef uint64_t Bitboard;
+
+// Piece types. color * 6 + type indexes PIECE_CODES
+// and the zobrist hash table
+enum piece_type {
+  PAWN,
+  ROOK,
+  KNIGHT,
+  BISHOP,
+  QUEEN,
+  KING,
+  NO_PIECE_TYPE
+};
+
+// Mailbox value for an empty square
+const int NO_PIECE = 12;
+
+const int NO_SQUARE = -1;
+
+// Piece codes indexed by color * 6 + type, same notation as the
+// print_board example. White pieces are uppercase, black lowercase
+extern const char PIECE_CODES[];
+
+const Bitboard FILE_A = 0x0101010101010101ULL;
+const Bitboard FILE_H = FILE_A << 7;
+const Bitboard RANK_1 = 0xFFULL;
+const Bitboard RANK_8 = RANK_1 << 56;
+
+// Attacks from a square, ignoring whose pieces are in the way.
+// Must be initialized with init_bitboards
+extern Bitboard KNIGHT_ATTACKS[64];
+extern Bitboard KING_ATTACKS[64];
+extern Bitboard PAWN_ATTACKS[2][64]; // Accessed as PAWN_ATTACKS[player_id][square]
+
+// Squares strictly between two squares on a shared rank, file or
+// diagonal. Empty if the squares aren't aligned
+extern Bitboard BETWEEN[64][64];
+
+// The whole rank, file or diagonal through two aligned squares,
+// edge to edge. Empty if the squares aren't aligned
+extern Bitboard LINE[64][64];
+
+void init_bitboards();
+
+inline Bitboard square_bb(int square) { return 1ULL << square; }
+
+inline int rank_of(int square) { return square >> 3; }
+
+inline int file_of(int square) { return square & 7; }
+
+inline int make_square(int rank, int file) { return rank * 8 + file; }
+
+// Set by init_bitboards if the CPU has a popcnt instruction.
+// Without one the compiler's builtin is a library call, and the
+// heuristic counts a lot of bits
+extern bool USE_POPCNT;
+
+inline int popcount(Bitboard b) {
+#if defined(__GNUC__) && defined(__x86_64__)
+  if (USE_POPCNT) {
+    Bitboard count;
+    asm("popcntq %1, %0" : "=r"(count) : "r"(b));
+    return int(count);
+  }
+#endif
+  return __builtin_popcountll(b);
+}
+
+// Index of the least significant set bit. b must not be empty
+inline int lsb(Bitboard b) { return __builtin_ctzll(b); }
+
+// Remove the least significant set bit and return its index
+inline int pop_lsb(Bitboard &b) {
+  int square = lsb(b);
+  b &= b - 1;
+  return square;
+}
+
+// Board-wide shifts by one square. Bits that would wrap
+// around to the other side of the board are masked off
+inline Bitboard shift_north(Bitboard b) { return b << 8; }
+inline Bitboard shift_south(Bitboard b) { return b >> 8; }
+inline Bitboard shift_east(Bitboard b) { return (b & ~FILE_H) << 1; }
+inline Bitboard shift_west(Bitboard b) { return (b & ~FILE_A) >> 1; }
+
+// Parallel bit extract is used for slider lookups when the CPU
+// supports BMI2. Emitted as inline assembly so the rest of the
+// client doesn't have to be compiled for BMI2.
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CPP_CLIENT_HAS_PEXT
+inline Bitboard pext(Bitboard b, Bitboard mask) {
+  Bitboard result;
+  asm("pextq %2, %1, %0" : "=r"(result) : "r"(b), "r"(mask));
+  return result;
+}
+#endif
+
+// Set by init_bitboards if the tables are indexed with pext
+// instead of magic multiplication
+extern bool USE_PEXT;
+
+// Slider attack lookup for one square. The occupancy bits that can
+// block the slider are hashed (by magic multiply or pext) into an
+// index into that square's slice of a shared attack table
+struct Magic {
+  Bitboard mask;      // Squares that can block the slider, excluding board edges
+  Bitboard magic;
+  Bitboard *attacks;
+  int shift;
+
+  unsigned index(Bitboard occupied) const {
+#ifdef CPP_CLIENT_HAS_PEXT
+    if (USE_PEXT) return unsigned(pext(occupied, mask));
+#endif
+    return unsigned(((occupied & mask) * magic) >> shift);
+  }
+};
+
+extern Magic ROOK_MAGICS[64];
+extern Magic BISHOP_MAGICS[64];
+
+// Squares attacked by a rook/bishop on square, stopping at
+// (and including) the first occupied square in each direction
+inline Bitboard rook_attacks(int square, Bitboard occupied) {
+  const Magic &m = ROOK_MAGICS[square];
+  return m.attacks[m.index(occupied)];
+}
+
+inline Bitboard bishop_attacks(int square, Bitboard occupied) {
+  const Magic &m = BISHOP_MAGICS[square];
+  return m.attacks[m.index(occupied)];
+}
+
+inline Bitboard queen_attacks(int square, Bitboard occupied) {
+  return rook_attacks(square, occupied) | bishop_attacks(square, occupied);
+}
+
+#endif //CPP_CLIENT_BITBOARD_HPP
@@ -0,0 +1,27 @@
+//////////////////////////////////////////////////////////////////////
+/// @file evalcache.cpp
+/// @brief Fixed-size cache of heuristic evaluations
+//////////////////////////////////////////////////////////////////////
+
+#include "evalcache.hpp"
+#include "transposition.hpp"
+
+EvalCache::EvalCache(size_t megabytes)
+    : m_mask(0) {
+  resize(megabytes);
+}
+
+void EvalCache::resize(size_t megabytes) {
+  size_t slots = table_entries(megabytes, sizeof(Slot));
+
+  m_slots.reset(new Slot[slots]);
+  m_mask = slots - 1;
+  clear();
+}
+
+void EvalCache::clear() {
+  for (uint64_t i = 0; i <= m_mask; i++) {
+    m_slots[i].key.store(0, std::memory_order_relaxed);
+    m_slots[i].data.store(0, std::memory_order_relaxed);
+  }
+}
@@ -0,0 +1,64 @@
+//////////////////////////////////////////////////////////////////////
+/// @file evalcache.hpp
+/// @brief Fixed-size cache of heuristic evaluations
+//////////////////////////////////////////////////////////////////////
+
+#ifndef CPP_CLIENT_EVALCACHE_HPP
+#define CPP_CLIENT_EVALCACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Mixed into a position's key for the side the eval is from, since
+// the heuristic isn't symmetric between the players
+const uint64_t EVAL_PERSPECTIVE_KEY[2] = {0, 0x9e3779b97f4a7c15ULL};
+
+// Leaf evals, kept apart from the transposition table so they don't
+// push out search results and are found whatever bounds a leaf was
+// searched with. Evals don't go stale, so this is never cleared
+// between turns.
+//
+// An eval costs far less to redo than a search result, so there are
+// no buckets or replacement rules: the newest eval for a slot wins.
+// The slot keeps the key XOR the eval, which lets threads race on it
+// and still never read back an eval for the wrong position.
+class EvalCache {
+ public:
+  EvalCache(size_t megabytes);
+
+  // Throws away everything stored and reallocates
+  void resize(size_t megabytes);
+
+  void clear();
+
+  // @return true and fills score if the key is stored
+  bool probe(uint64_t key, int &score) const {
+    const Slot &slot = m_slots[key & m_mask];
+    uint64_t data = slot.data.load(std::memory_order_relaxed);
+    if ((slot.key.load(std::memory_order_relaxed) ^ data) != key or data == 0) return false;
+    score = int32_t(uint32_t(data));
+    return true;
+  }
+
+  void store(uint64_t key, int score) {
+    Slot &slot = m_slots[key & m_mask];
+    uint64_t data = uint64_t(uint32_t(score)) | STORED;
+    slot.key.store(key ^ data, std::memory_order_relaxed);
+    slot.data.store(data, std::memory_order_relaxed);
+  }
+
+ private:
+  // Set in every slot's data, so an empty slot never matches
+  static const uint64_t STORED = 1ULL << 32;
+
+  struct Slot {
+    std::atomic<uint64_t> key;   // The position's key XOR data
+    std::atomic<uint64_t> data;  // score (32 bits), STORED
+  };
+
+  std::unique_ptr<Slot[]> m_slots;
+  uint64_t m_mask;
+};
+
+#endif //CPP_CLIENT_EVALCACHE_HPP
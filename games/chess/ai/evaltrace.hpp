@@ -0,0 +1,47 @@
+//////////////////////////////////////////////////////////////////////
+/// @file evaltrace.hpp
+/// @brief Records how the heuristic used each weight, for tuning them
+//////////////////////////////////////////////////////////////////////
+
+#ifndef CPP_CLIENT_EVALTRACE_HPP
+#define CPP_CLIENT_EVALTRACE_HPP
+
+// Only chess-tuner is built with CPP_CLIENT_TUNE. Everywhere
+// else TRACE compiles to nothing and the client is unchanged
+#ifdef CPP_CLIENT_TUNE
+
+#include "pst.hpp"
+
+// What each weight in weights.hpp was multiplied by, summed up,
+// counting white's terms as positive and black's as negative
+struct EvalTrace {
+  int guard_own_pieces;    // Value of the pieces guarded
+  int pieces_can_capture;  // Value of the pieces threatened
+  int doubled;
+  int isolated;
+  int backward;
+  int passed[8];
+  int shield;
+  int mobility[NO_PIECE_TYPE];      // Safe squares attacked
+  int king_attacks[NO_PIECE_TYPE];  // Attacks on the enemy king's zone
+  int hanging;
+  int phase;               // Midgame terms count phase / MAX_PHASE
+};
+
+extern thread_local EvalTrace eval_trace;
+
+#define TRACE(term, count) (eval_trace.term += (count))
+
+// Evaluates positions for the player to move, without allocating
+// anything, so the tuner can run batches of them on every thread
+// @param fens : positions in Forsyth-Edwards Notation, or EPD lines
+// @post scores has each eval from white's side, traces what went into it
+void trace_eval_batch(const char *const fens[], int count, int scores[], EvalTrace traces[]);
+
+#else
+
+#define TRACE(term, count) ((void)0)
+
+#endif // CPP_CLIENT_TUNE
+
+#endif //CPP_CLIENT_EVALTRACE_HPP
@@ -1,46 +1,67 @@
 #include "hash.hpp"
+#include "zobrist.hpp"
 
-const std::map<char, int> HASH_INDICES{
-    {'P', 0},
-    {'R', 1},
-    {'N', 2},
-    {'B', 3},
-    {'Q', 4},
-    {'K', 5},
-    {'p', 6},
-    {'r', 7},
-    {'n', 8},
-    {'b', 9},
-    {'q', 10},
-    {'k', 11}
-};
+// Global hash tables. Must be initialized with init_zobrist_hash_table
+uint64_t ZOBRIST_HASH_TABLE[12][64];
+uint64_t ZOBRIST_CASTLING[16];
+uint64_t ZOBRIST_EN_PASSANT[8];
+uint64_t ZOBRIST_BLACK_TO_MOVE;
 
-// Global hash table. Must be initialized with init_zobrist_hash_table
-long ZOBRIST_HASH_TABLE[8][8][12];
+// splitmix64. Gives full 64 bit keys (random() only gives 31),
+// and the fixed seed keeps hashes the same from run to run
+static uint64_t zobrist_random(uint64_t &seed) {
+  uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
 
 void init_zobrist_hash_table() {
-  for (int i = 0; i < 8; i++) {
-    for (int j = 0; j < 8; j++) {
-      for (int k = 0; k < 12; k++) {
-        ZOBRIST_HASH_TABLE[i][j][k] = random();
-      }
+  uint64_t seed = 1070372;
+  for (int piece = 0; piece < 12; piece++) {
+    for (int square = 0; square < 64; square++) {
+      ZOBRIST_HASH_TABLE[piece][square] = zobrist_random(seed);
     }
   }
+  for (int i = 0; i < 16; i++) {
+    ZOBRIST_CASTLING[i] = zobrist_random(seed);
+  }
+  for (int file = 0; file < 8; file++) {
+    ZOBRIST_EN_PASSANT[file] = zobrist_random(seed);
+  }
+  ZOBRIST_BLACK_TO_MOVE = zobrist_random(seed);
 }
 
-long State::hash() const {
-  long hash = 0;
-  for (int i = 0; i < 8; i++) {
-    for (int j = 0; j < 8; j++) {
-      char piece = m_collision_map[i][j];
-      if (piece != 0) {
-        hash ^= ZOBRIST_HASH_TABLE[i][j][HASH_INDICES.at(piece)];
+uint64_t State::hash() const {
+  return m_hash;
+}
+
+uint64_t State::compute_hash() const {
+  uint64_t hash = 0;
+  for (int player_id = 0; player_id < 2; player_id++) {
+    for (int type = PAWN; type < NO_PIECE_TYPE; type++) {
+      Bitboard pieces = m_pieces[player_id][type];
+      while (pieces) {
+        hash ^= ZOBRIST_HASH_TABLE[player_id * 6 + type][pop_lsb(pieces)];
       }
     }
   }
+  if (m_active_player == 1) hash ^= ZOBRIST_BLACK_TO_MOVE;
+  hash ^= ZOBRIST_CASTLING[castling_index()];
+  hash ^= en_passant_hash();
   return hash;
 }
 
+uint64_t State::en_passant_hash() const {
+  // Only count the en passant square when a pawn can actually take it.
+  // Otherwise the position is the same as if the pawn had moved one square
+  if (m_en_passant == NO_SQUARE) return 0;
+  int opponent_id = 1 - m_active_player;
+  if (!(PAWN_ATTACKS[opponent_id][m_en_passant] & m_pieces[m_active_player][PAWN])) return 0;
+  return ZOBRIST_EN_PASSANT[file_of(m_en_passant)];
+}
+
 long Action::hash() const {
-  return m_parent->hash() ^ ZOBRIST_HASH_TABLE[m_space.rank][m_space.file][HASH_INDICES.at(m_piece.type)];
+  // The packed move is already a unique key
+  return m_data;
 }
\ No newline at end of file
@@ -3,67 +3,169 @@
 //
 
 #include "state.hpp"
+#include "pst.hpp"
+#include "pawns.hpp"
+#include "weights.hpp"
+#include "evaltrace.hpp"
 
-// Relative weights of different parts of heuristic
-const int WEIGHT_PIECES_OWNED = 25;
-const int WEIGHT_PIECES_CAN_CAPTURE = 3;
-const int WEIGHT_OPPONENT_PIECES = -20;
-const int WEIGHT_PAWN_ADVANCEMENT = 2;
-const int WEIGHT_GUARD_OWN_PIECES = 5;
+// Each search thread evaluates different positions, so each gets its own
+thread_local PawnHashTable pawn_hash_table;
 
-// Values assigned to situations and actions
-const int IN_CHECK_VALUE = 50;
+const int MATERIAL_VALUE[NO_PIECE_TYPE]{
+    MIDGAME_VALUE[PAWN],
+    MIDGAME_VALUE[ROOK],
+    MIDGAME_VALUE[KNIGHT],
+    MIDGAME_VALUE[BISHOP],
+    MIDGAME_VALUE[QUEEN],
+    MIDGAME_VALUE[KING],
+};
+
+// Mobility and king attack weights by piece type, for the pieces that have them
+static const int *const MOBILITY[NO_PIECE_TYPE]{
+    NULL, ROOK_MOBILITY, KNIGHT_MOBILITY, BISHOP_MOBILITY, QUEEN_MOBILITY, NULL,
+};
 
-const int KNIGHT_STRENGTH_TABLE[8][8]{
-    {}
+static const int KING_ATTACK[NO_PIECE_TYPE]{
+    0, ROOK_KING_ATTACK, KNIGHT_KING_ATTACK, BISHOP_KING_ATTACK, QUEEN_KING_ATTACK, 0,
 };
 
-const std::map<char, int> PIECE_VALUE{
-    {'P', 1},
-    {'R', 5},
-    {'N', 3},
-    {'B', 3},
-    {'Q', 9},
-    {'K', 0}, // Can't be taken
+// Everything the eval needs to know about the squares one player attacks.
+// Built once per eval, so each term is a popcount of these boards
+struct Attacks {
+  Bitboard all;                       // Every square attacked by any piece
+  int mobility[NO_PIECE_TYPE];        // Safe squares attacked, summed over each type's pieces
+  int king_attacks[NO_PIECE_TYPE];    // Attacks on the enemy king's zone, the same way
 };
 
+static Bitboard pawn_attacks(Bitboard pawns, int player_id) {
+  Bitboard forward = player_id == 0 ? shift_north(pawns) : shift_south(pawns);
+  return shift_east(forward) | shift_west(forward);
+}
+
+// Squares a piece of the type on square attacks
+static Bitboard piece_attacks(int type, int square, Bitboard occupied) {
+  switch (type) {
+    case ROOK: return rook_attacks(square, occupied);
+    case KNIGHT: return KNIGHT_ATTACKS[square];
+    case BISHOP: return bishop_attacks(square, occupied);
+    default: return queen_attacks(square, occupied);
+  }
+}
+
+// A move to a square the opponent's pawns guard is rarely safe, and a
+// piece can't move onto its own side's pieces, so neither count as mobility
+static void build_attacks(const Bitboard pieces[2][NO_PIECE_TYPE], Bitboard occupied, Attacks attacks[2]) {
+  Bitboard guarded_by_pawns[2] = {pawn_attacks(pieces[0][PAWN], 0), pawn_attacks(pieces[1][PAWN], 1)};
+
+  for (int player_id = 0; player_id < 2; player_id++) {
+    Attacks &a = attacks[player_id];
+    int enemy_king = lsb(pieces[1 - player_id][KING]);
+    Bitboard king_zone = KING_ATTACKS[enemy_king] | square_bb(enemy_king);
+    Bitboard own = 0;
+    for (int type = PAWN; type < NO_PIECE_TYPE; type++) own |= pieces[player_id][type];
+    Bitboard safe = ~own & ~guarded_by_pawns[1 - player_id];
+
+    a.all = guarded_by_pawns[player_id] | KING_ATTACKS[lsb(pieces[player_id][KING])];
+    for (int type = ROOK; type <= QUEEN; type++) {
+      a.mobility[type] = 0;
+      a.king_attacks[type] = 0;
+      Bitboard remaining = pieces[player_id][type];
+      while (remaining) {
+        Bitboard attacked = piece_attacks(type, pop_lsb(remaining), occupied);
+        a.all |= attacked;
+        a.mobility[type] += popcount(attacked & safe);
+        a.king_attacks[type] += popcount(attacked & king_zone);
+      }
+    }
+  }
+}
+
 int State::heuristic_eval(int player_id) const {
   assert((player_id == 0) | (player_id == 1));
   int opponent_id = (player_id == 0 ? 1 : 0);
-  int score = 0;
 
-  // Add pieces owned by the player
-  for (const auto &piece: m_player_pieces[player_id]) {
-    score += WEIGHT_PIECES_OWNED * PIECE_VALUE.at(piece.type);
+  if (USE_NNUE) return nnue_evaluate(m_accumulator, player_id);
 
-    // Encourage pieces to guard other pieces
-    if (space_threatened(piece.location, player_id)) {
-      score += WEIGHT_GUARD_OWN_PIECES * PIECE_VALUE.at(piece.type);
-    }
+  // Material and piece-square tables, for the player minus the opponent
+  int midgame = m_midgame[player_id] - m_midgame[opponent_id];
+  int endgame = m_endgame[player_id] - m_endgame[opponent_id];
+
+  // Pawn structure, which is stored from white's side
+  const Bitboard pawns[2] = {m_pieces[0][PAWN], m_pieces[1][PAWN]};
+#ifdef CPP_CLIENT_TUNE
+  // Every position has to be traced, so don't skip any through the cache
+  PawnEntry pawn_entry;
+  evaluate_pawns(pawns, pawn_entry);
+#else
+  const PawnEntry &pawn_entry = pawn_hash_table.probe(m_pawn_hash, pawns);
+#endif
+  int sign = player_id == 0 ? 1 : -1;
+  midgame += sign * pawn_entry.midgame;
+  endgame += sign * pawn_entry.endgame;
+
+  // Pawns sheltering the king only matter while there are pieces to attack it
+  midgame += pawn_shield(player_id, lsb(m_pieces[player_id][KING]), pawns[player_id]);
+  midgame -= pawn_shield(opponent_id, lsb(m_pieces[opponent_id][KING]), pawns[opponent_id]);
 
-    // Try to get pawns staggered off the home row
-    if (piece.type == 'P' && piece.location.file % 2) {
-      int advancement = player_id == 0 ? piece.location.rank - 1 : 6 - piece.location.rank;
-      score += WEIGHT_PAWN_ADVANCEMENT * advancement;
+  // Piece activity, from the squares each side's pieces attack
+  int guard_value = 0, threat_value = 0;
+  Attacks attacks[2];
+  build_attacks(m_pieces, m_occupancy[0] | m_occupancy[1], attacks);
+  for (int side = 0; side < 2; side++) {
+    int side_sign = side == player_id ? 1 : -1;
+#ifdef CPP_CLIENT_TUNE
+    int white_sign = side == 0 ? 1 : -1;
+#endif
+    const Attacks &own = attacks[side];
+    for (int type = ROOK; type <= QUEEN; type++) {
+      midgame += side_sign * own.mobility[type] * MOBILITY[type][0];
+      endgame += side_sign * own.mobility[type] * MOBILITY[type][1];
+      midgame += side_sign * own.king_attacks[type] * KING_ATTACK[type];
+      TRACE(mobility[type], white_sign * own.mobility[type]);
+      TRACE(king_attacks[type], white_sign * own.king_attacks[type]);
     }
-  }
 
-  for (const auto &piece: m_player_pieces[opponent_id]) {
-    score += WEIGHT_OPPONENT_PIECES * PIECE_VALUE.at(piece.type);
-  }
+    // Enemy pieces that can be taken for free
+    Bitboard enemy = m_occupancy[1 - side] & ~m_pieces[1 - side][KING];
+    int hanging = popcount(enemy & own.all & ~attacks[1 - side].all);
+    midgame += side_sign * hanging * HANGING_PIECE[0];
+    endgame += side_sign * hanging * HANGING_PIECE[1];
+    TRACE(hanging, white_sign * hanging);
 
-  // Add pieces threatened by the player
-  for (const auto &piece : m_player_pieces[opponent_id]) {
-    if (space_threatened(piece.location, player_id)) {
-      score += WEIGHT_PIECES_CAN_CAPTURE * PIECE_VALUE.at(piece.type);
+    // Pieces guarding each other, and threatening the enemy's
+    for (int type = PAWN; type < NO_PIECE_TYPE; type++) {
+      int guarded = popcount(m_pieces[side][type] & own.all);
+      int threatened = popcount(m_pieces[1 - side][type] & own.all);
+      guard_value += side_sign * guarded * MATERIAL_VALUE[type];
+      threat_value += side_sign * threatened * MATERIAL_VALUE[type];
+      TRACE(guard_own_pieces, white_sign * guarded * MATERIAL_VALUE[type]);
+      TRACE(pieces_can_capture, white_sign * threatened * MATERIAL_VALUE[type]);
     }
   }
 
+  int phase = m_phase < MAX_PHASE ? m_phase : MAX_PHASE;
+  int score = (midgame * phase + endgame * (MAX_PHASE - phase)) / MAX_PHASE;
+  TRACE(phase, phase);
+
+  // Percent of the value of the pieces guarded and threatened
+  score += (WEIGHT_GUARD_OWN_PIECES * guard_value + WEIGHT_PIECES_CAN_CAPTURE * threat_value) / 100;
+
   return score;
 }
 
-bool State::is_non_quiescent() const {
-  // Very very simple quiescence detection
-  // if the last piece we moved is in danger, look deeper
-  return space_threatened(m_last_move, m_active_player);
-}
\ No newline at end of file
+#ifdef CPP_CLIENT_TUNE
+
+thread_local EvalTrace eval_trace;
+
+void trace_eval_batch(const char *const fens[], int count, int scores[], EvalTrace traces[]) {
+  for (int i = 0; i < count; i++) {
+    State state(fens[i]);
+    int player_id = state.get_active_player();
+    eval_trace = EvalTrace();
+    int score = state.heuristic_eval(player_id);
+    scores[i] = player_id == 0 ? score : -score;
+    traces[i] = eval_trace;
+  }
+}
+
+#endif // CPP_CLIENT_TUNE
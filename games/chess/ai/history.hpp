@@ -0,0 +1,40 @@
+//////////////////////////////////////////////////////////////////////
+/// @file history.hpp
+/// @brief History heuristic scores for ordering quiet actions
+//////////////////////////////////////////////////////////////////////
+
+#ifndef CPP_CLIENT_HISTORY_HPP
+#define CPP_CLIENT_HISTORY_HPP
+
+#include "action.hpp"
+
+// How well each quiet action has done at causing cutoffs, indexed
+// by the side that played it and its from and to squares. A plain
+// array, so scoring and updating it never allocates
+struct HistoryTable {
+  int scores[2][64][64];
+
+  HistoryTable() { clear(); }
+
+  void clear() {
+    for (auto &side : scores) {
+      for (auto &from : side) {
+        for (int &score : from) score = 0;
+      }
+    }
+  }
+
+  // Halve every score, so old cutoffs count for less than new ones
+  void age() {
+    for (auto &side : scores) {
+      for (auto &from : side) {
+        for (int &score : from) score /= 2;
+      }
+    }
+  }
+
+  int &at(int side, const Action &action) { return scores[side][action.from()][action.to()]; }
+  int at(int side, const Action &action) const { return scores[side][action.from()][action.to()]; }
+};
+
+#endif //CPP_CLIENT_HISTORY_HPP
@@ -0,0 +1,446 @@
+//////////////////////////////////////////////////////////////////////
+/// @file nnue.cpp
+/// @brief Efficiently updatable neural network evaluation
+//////////////////////////////////////////////////////////////////////
+
+#include "nnue.hpp"
+
+#include <cstring>
+#include <iostream>
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Kernels for wider registers are compiled with target attributes and
+// picked at runtime, so the rest of the client doesn't have to be
+// compiled for AVX2 or SSE4.1.
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CPP_CLIENT_HAS_SIMD
+#include <immintrin.h>
+#endif
+
+simd_level NNUE_SIMD = SIMD_NONE;
+bool USE_NNUE = false;
+
+// Hidden layer sums are scaled down by 2^WEIGHT_SCALE_BITS before
+// clipping, and the output by OUTPUT_SCALE to give centipawns
+const int WEIGHT_SCALE_BITS = 6;
+const int OUTPUT_SCALE = 16;
+const int CLIP_MAX = 127;
+
+const uint32_t NETWORK_VERSION = 1;
+const size_t HEADER_SIZE = 64;
+
+// Offsets of each array in the file, all multiples of 32 bytes
+const size_t FEATURE_BIASES_OFFSET = HEADER_SIZE;
+const size_t FEATURE_WEIGHTS_OFFSET = FEATURE_BIASES_OFFSET + NNUE_HALF_DIMENSIONS * sizeof(int16_t);
+const size_t HIDDEN1_BIASES_OFFSET =
+    FEATURE_WEIGHTS_OFFSET + size_t(NNUE_INPUTS) * NNUE_HALF_DIMENSIONS * sizeof(int16_t);
+const size_t HIDDEN1_WEIGHTS_OFFSET = HIDDEN1_BIASES_OFFSET + NNUE_HIDDEN_DIMENSIONS * sizeof(int32_t);
+const size_t HIDDEN2_BIASES_OFFSET = HIDDEN1_WEIGHTS_OFFSET + NNUE_HIDDEN_DIMENSIONS * 2 * NNUE_HALF_DIMENSIONS;
+const size_t HIDDEN2_WEIGHTS_OFFSET = HIDDEN2_BIASES_OFFSET + NNUE_HIDDEN_DIMENSIONS * sizeof(int32_t);
+const size_t OUTPUT_BIAS_OFFSET = HIDDEN2_WEIGHTS_OFFSET + NNUE_HIDDEN_DIMENSIONS * NNUE_HIDDEN_DIMENSIONS;
+const size_t OUTPUT_WEIGHTS_OFFSET = OUTPUT_BIAS_OFFSET + 32;
+const size_t NETWORK_FILE_SIZE = OUTPUT_WEIGHTS_OFFSET + NNUE_HIDDEN_DIMENSIONS;
+
+// Points into the memory mapped file
+struct Network {
+  const int16_t *feature_biases;
+  const int16_t *feature_weights;  // One row of NNUE_HALF_DIMENSIONS per input
+  const int32_t *hidden1_biases;
+  const int8_t *hidden1_weights;
+  const int32_t *hidden2_biases;
+  const int8_t *hidden2_weights;
+  const int32_t *output_bias;
+  const int8_t *output_weights;
+};
+
+static Network network;
+
+//////////////////////////////////////////////////////////////////////
+/// Kernels
+//////////////////////////////////////////////////////////////////////
+
+static void add_row_scalar(int16_t *values, const int16_t *row) {
+  for (int i = 0; i < NNUE_HALF_DIMENSIONS; i++) values[i] += row[i];
+}
+
+static void subtract_row_scalar(int16_t *values, const int16_t *row) {
+  for (int i = 0; i < NNUE_HALF_DIMENSIONS; i++) values[i] -= row[i];
+}
+
+// Accumulator values clamped to [0, CLIP_MAX]
+static void clipped_relu_scalar(const int16_t *values, uint8_t *output) {
+  for (int i = 0; i < NNUE_HALF_DIMENSIONS; i++) {
+    int value = values[i];
+    output[i] = uint8_t(value < 0 ? 0 : value > CLIP_MAX ? CLIP_MAX : value);
+  }
+}
+
+// output[i] = biases[i] + the dot product of weight row i with input
+static void affine_scalar(const uint8_t *input, int input_size, const int8_t *weights,
+                          const int32_t *biases, int output_size, int32_t *output) {
+  for (int i = 0; i < output_size; i++) {
+    const int8_t *row = weights + i * input_size;
+    int32_t sum = biases[i];
+    for (int j = 0; j < input_size; j++) sum += row[j] * input[j];
+    output[i] = sum;
+  }
+}
+
+#ifdef CPP_CLIENT_HAS_SIMD
+
+__attribute__((target("avx2")))
+static void add_row_avx2(int16_t *values, const int16_t *row) {
+  for (int i = 0; i < NNUE_HALF_DIMENSIONS; i += 16) {
+    __m256i *v = reinterpret_cast<__m256i *>(values + i);
+    __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i));
+    _mm256_storeu_si256(v, _mm256_add_epi16(_mm256_loadu_si256(v), r));
+  }
+}
+
+__attribute__((target("avx2")))
+static void subtract_row_avx2(int16_t *values, const int16_t *row) {
+  for (int i = 0; i < NNUE_HALF_DIMENSIONS; i += 16) {
+    __m256i *v = reinterpret_cast<__m256i *>(values + i);
+    __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + i));
+    _mm256_storeu_si256(v, _mm256_sub_epi16(_mm256_loadu_si256(v), r));
+  }
+}
+
+__attribute__((target("avx2")))
+static void clipped_relu_avx2(const int16_t *values, uint8_t *output) {
+  const __m256i zero = _mm256_setzero_si256();
+  for (int i = 0; i < NNUE_HALF_DIMENSIONS; i += 32) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i + 16));
+    // Packing works within each 128 bit lane, so put the quarters back in order
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(a, b), 0xD8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(output + i), _mm256_max_epi8(packed, zero));
+  }
+}
+
+// Inputs are at most CLIP_MAX, so the pairs of products maddubs adds
+// together can't saturate 16 bits. Rows are done four at a time so
+// their sums don't wait on each other, then added up across together
+__attribute__((target("avx2")))
+static inline __m256i dot_avx2(__m256i sum, __m256i in, const int8_t *row, __m256i ones) {
+  __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row));
+  return _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(in, w), ones));
+}
+
+__attribute__((target("avx2")))
+static void affine_avx2(const uint8_t *input, int input_size, const int8_t *weights,
+                        const int32_t *biases, int output_size, int32_t *output) {
+  const __m256i ones = _mm256_set1_epi16(1);
+  int i = 0;
+  for (; i + 4 <= output_size; i += 4) {
+    const int8_t *row = weights + i * input_size;
+    __m256i sum0 = _mm256_setzero_si256(), sum1 = sum0, sum2 = sum0, sum3 = sum0;
+    for (int j = 0; j < input_size; j += 32) {
+      __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input + j));
+      sum0 = dot_avx2(sum0, in, row + j, ones);
+      sum1 = dot_avx2(sum1, in, row + input_size + j, ones);
+      sum2 = dot_avx2(sum2, in, row + 2 * input_size + j, ones);
+      sum3 = dot_avx2(sum3, in, row + 3 * input_size + j, ones);
+    }
+    __m256i sums = _mm256_hadd_epi32(_mm256_hadd_epi32(sum0, sum1), _mm256_hadd_epi32(sum2, sum3));
+    __m128i total = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    total = _mm_add_epi32(total, _mm_loadu_si128(reinterpret_cast<const __m128i *>(biases + i)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i), total);
+  }
+  for (; i < output_size; i++) {
+    const int8_t *row = weights + i * input_size;
+    __m256i sum = _mm256_setzero_si256();
+    for (int j = 0; j < input_size; j += 32) {
+      sum = dot_avx2(sum, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input + j)), row + j, ones);
+    }
+    __m128i total = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    total = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0x4E));
+    total = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0xB1));
+    output[i] = biases[i] + _mm_cvtsi128_si32(total);
+  }
+}
+
+__attribute__((target("sse4.1")))
+static void add_row_sse41(int16_t *values, const int16_t *row) {
+  for (int i = 0; i < NNUE_HALF_DIMENSIONS; i += 8) {
+    __m128i *v = reinterpret_cast<__m128i *>(values + i);
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+    _mm_storeu_si128(v, _mm_add_epi16(_mm_loadu_si128(v), r));
+  }
+}
+
+__attribute__((target("sse4.1")))
+static void subtract_row_sse41(int16_t *values, const int16_t *row) {
+  for (int i = 0; i < NNUE_HALF_DIMENSIONS; i += 8) {
+    __m128i *v = reinterpret_cast<__m128i *>(values + i);
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+    _mm_storeu_si128(v, _mm_sub_epi16(_mm_loadu_si128(v), r));
+  }
+}
+
+__attribute__((target("sse4.1")))
+static void clipped_relu_sse41(const int16_t *values, uint8_t *output) {
+  const __m128i zero = _mm_setzero_si128();
+  for (int i = 0; i < NNUE_HALF_DIMENSIONS; i += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(values + i + 8));
+    __m128i packed = _mm_packs_epi16(a, b);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i), _mm_max_epi8(packed, zero));
+  }
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i dot_sse41(__m128i sum, __m128i in, const int8_t *row, __m128i ones) {
+  __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row));
+  return _mm_add_epi32(sum, _mm_madd_epi16(_mm_maddubs_epi16(in, w), ones));
+}
+
+__attribute__((target("sse4.1")))
+static void affine_sse41(const uint8_t *input, int input_size, const int8_t *weights,
+                         const int32_t *biases, int output_size, int32_t *output) {
+  const __m128i ones = _mm_set1_epi16(1);
+  int i = 0;
+  for (; i + 4 <= output_size; i += 4) {
+    const int8_t *row = weights + i * input_size;
+    __m128i sum0 = _mm_setzero_si128(), sum1 = sum0, sum2 = sum0, sum3 = sum0;
+    for (int j = 0; j < input_size; j += 16) {
+      __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + j));
+      sum0 = dot_sse41(sum0, in, row + j, ones);
+      sum1 = dot_sse41(sum1, in, row + input_size + j, ones);
+      sum2 = dot_sse41(sum2, in, row + 2 * input_size + j, ones);
+      sum3 = dot_sse41(sum3, in, row + 3 * input_size + j, ones);
+    }
+    __m128i total = _mm_hadd_epi32(_mm_hadd_epi32(sum0, sum1), _mm_hadd_epi32(sum2, sum3));
+    total = _mm_add_epi32(total, _mm_loadu_si128(reinterpret_cast<const __m128i *>(biases + i)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + i), total);
+  }
+  for (; i < output_size; i++) {
+    const int8_t *row = weights + i * input_size;
+    __m128i sum = _mm_setzero_si128();
+    for (int j = 0; j < input_size; j += 16) {
+      sum = dot_sse41(sum, _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + j)), row + j, ones);
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    output[i] = biases[i] + _mm_cvtsi128_si32(sum);
+  }
+}
+
+#endif // CPP_CLIENT_HAS_SIMD
+
+static void add_row(int16_t *values, const int16_t *row) {
+#ifdef CPP_CLIENT_HAS_SIMD
+  if (NNUE_SIMD == SIMD_AVX2) return add_row_avx2(values, row);
+  if (NNUE_SIMD == SIMD_SSE41) return add_row_sse41(values, row);
+#endif
+  add_row_scalar(values, row);
+}
+
+static void subtract_row(int16_t *values, const int16_t *row) {
+#ifdef CPP_CLIENT_HAS_SIMD
+  if (NNUE_SIMD == SIMD_AVX2) return subtract_row_avx2(values, row);
+  if (NNUE_SIMD == SIMD_SSE41) return subtract_row_sse41(values, row);
+#endif
+  subtract_row_scalar(values, row);
+}
+
+static void clipped_relu(const int16_t *values, uint8_t *output) {
+#ifdef CPP_CLIENT_HAS_SIMD
+  if (NNUE_SIMD == SIMD_AVX2) return clipped_relu_avx2(values, output);
+  if (NNUE_SIMD == SIMD_SSE41) return clipped_relu_sse41(values, output);
+#endif
+  clipped_relu_scalar(values, output);
+}
+
+// The SIMD versions need input_size to be a multiple of their width
+static void affine(const uint8_t *input, int input_size, const int8_t *weights,
+                   const int32_t *biases, int output_size, int32_t *output) {
+#ifdef CPP_CLIENT_HAS_SIMD
+  if (NNUE_SIMD == SIMD_AVX2) return affine_avx2(input, input_size, weights, biases, output_size, output);
+  if (NNUE_SIMD == SIMD_SSE41) return affine_sse41(input, input_size, weights, biases, output_size, output);
+#endif
+  affine_scalar(input, input_size, weights, biases, output_size, output);
+}
+
+// Scale a hidden layer's sums down and clamp them to [0, CLIP_MAX]
+static void activate(const int32_t *sums, uint8_t *output) {
+  for (int i = 0; i < NNUE_HIDDEN_DIMENSIONS; i++) {
+    int32_t value = sums[i] >> WEIGHT_SCALE_BITS;
+    output[i] = uint8_t(value < 0 ? 0 : value > CLIP_MAX ? CLIP_MAX : value);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+/// Features
+//////////////////////////////////////////////////////////////////////
+
+// Black sees the board flipped, the same as the piece-square tables.
+// The side's own pieces are kinds 0-4, the opponent's 5-9
+static inline int feature_index(int side, int king_square, int player_id, int type, int square) {
+  if (side == 1) {
+    king_square ^= 56;
+    square ^= 56;
+  }
+  int kind = type + (player_id == side ? 0 : 5);
+  return (king_square * 10 + kind) * 64 + square;
+}
+
+static inline const int16_t *feature_row(int side, int king_square, int player_id, int type, int square) {
+  return network.feature_weights
+      + size_t(feature_index(side, king_square, player_id, type, square)) * NNUE_HALF_DIMENSIONS;
+}
+
+void nnue_refresh(Accumulator &accumulator, int side, const Bitboard pieces[2][6]) {
+  int king_square = lsb(pieces[side][KING]);
+  int16_t *values = accumulator.values[side];
+  std::memcpy(values, network.feature_biases, NNUE_HALF_DIMENSIONS * sizeof(int16_t));
+  for (int player_id = 0; player_id < 2; player_id++) {
+    for (int type = PAWN; type < KING; type++) {
+      Bitboard b = pieces[player_id][type];
+      while (b) add_row(values, feature_row(side, king_square, player_id, type, pop_lsb(b)));
+    }
+  }
+  accumulator.king_square[side] = king_square;
+}
+
+void nnue_add_piece(Accumulator &accumulator, int player_id, int type, int square) {
+  for (int side = 0; side < 2; side++) {
+    int king_square = accumulator.king_square[side];
+    if (king_square == NO_SQUARE) continue;  // Worked out in full once the king is placed
+    add_row(accumulator.values[side], feature_row(side, king_square, player_id, type, square));
+  }
+}
+
+void nnue_remove_piece(Accumulator &accumulator, int player_id, int type, int square) {
+  for (int side = 0; side < 2; side++) {
+    int king_square = accumulator.king_square[side];
+    if (king_square == NO_SQUARE) continue;
+    subtract_row(accumulator.values[side], feature_row(side, king_square, player_id, type, square));
+  }
+}
+
+int nnue_evaluate(const Accumulator &accumulator, int player_id) {
+  alignas(32) uint8_t input[2 * NNUE_HALF_DIMENSIONS];
+  alignas(32) uint8_t hidden1[NNUE_HIDDEN_DIMENSIONS];
+  alignas(32) uint8_t hidden2[NNUE_HIDDEN_DIMENSIONS];
+  int32_t sums[NNUE_HIDDEN_DIMENSIONS];
+  int32_t output;
+
+  clipped_relu(accumulator.values[player_id], input);
+  clipped_relu(accumulator.values[1 - player_id], input + NNUE_HALF_DIMENSIONS);
+
+  affine(input, 2 * NNUE_HALF_DIMENSIONS, network.hidden1_weights, network.hidden1_biases,
+         NNUE_HIDDEN_DIMENSIONS, sums);
+  activate(sums, hidden1);
+  affine(hidden1, NNUE_HIDDEN_DIMENSIONS, network.hidden2_weights, network.hidden2_biases,
+         NNUE_HIDDEN_DIMENSIONS, sums);
+  activate(sums, hidden2);
+  affine(hidden2, NNUE_HIDDEN_DIMENSIONS, network.output_weights, network.output_bias, 1, &output);
+
+  return output / OUTPUT_SCALE;
+}
+
+//////////////////////////////////////////////////////////////////////
+/// Loading
+//////////////////////////////////////////////////////////////////////
+
+// The network is read only and kept until the client exits,
+// so every search thread can share it.
+// @return the whole file, or NULL if it can't be read or is the wrong size
+#ifdef _WIN32
+// Read into memory, since the POSIX calls below aren't available
+static const char *map_network(const std::string &path) {
+  std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+  if (!file) {
+    std::cerr << "Couldn't open network " << path << std::endl;
+    return NULL;
+  }
+  if (size_t(file.tellg()) != NETWORK_FILE_SIZE) {
+    std::cerr << "Network " << path << " should be " << NETWORK_FILE_SIZE << " bytes" << std::endl;
+    return NULL;
+  }
+  char *data = new char[NETWORK_FILE_SIZE];
+  file.seekg(0);
+  if (!file.read(data, NETWORK_FILE_SIZE)) {
+    std::cerr << "Couldn't read network " << path << std::endl;
+    delete[] data;
+    return NULL;
+  }
+  return data;
+}
+
+static void unmap_network(const char *data) {
+  delete[] data;
+}
+#else
+static const char *map_network(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Couldn't open network " << path << std::endl;
+    return NULL;
+  }
+  struct stat status;
+  if (fstat(fd, &status) != 0 or size_t(status.st_size) != NETWORK_FILE_SIZE) {
+    std::cerr << "Network " << path << " should be " << NETWORK_FILE_SIZE << " bytes" << std::endl;
+    close(fd);
+    return NULL;
+  }
+
+  void *memory = mmap(NULL, NETWORK_FILE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) {
+    std::cerr << "Couldn't map network " << path << std::endl;
+    return NULL;
+  }
+
+  // Feature rows are read in no particular order, so get them into memory up front
+  madvise(memory, NETWORK_FILE_SIZE, MADV_WILLNEED);
+  return static_cast<const char *>(memory);
+}
+
+static void unmap_network(const char *data) {
+  munmap(const_cast<char *>(data), NETWORK_FILE_SIZE);
+}
+#endif
+
+bool nnue_load(const std::string &path) {
+  const char *data = map_network(path);
+  if (data == NULL) return false;
+
+  uint32_t header[4];
+  std::memcpy(header, data + 4, sizeof(header));
+  if (std::memcmp(data, "NNUE", 4) != 0 or header[0] != NETWORK_VERSION
+      or header[1] != uint32_t(NNUE_INPUTS) or header[2] != uint32_t(NNUE_HALF_DIMENSIONS)
+      or header[3] != uint32_t(NNUE_HIDDEN_DIMENSIONS)) {
+    std::cerr << "Network " << path << " isn't a version " << NETWORK_VERSION
+              << " network with the right dimensions" << std::endl;
+    unmap_network(data);
+    return false;
+  }
+
+  network.feature_biases = reinterpret_cast<const int16_t *>(data + FEATURE_BIASES_OFFSET);
+  network.feature_weights = reinterpret_cast<const int16_t *>(data + FEATURE_WEIGHTS_OFFSET);
+  network.hidden1_biases = reinterpret_cast<const int32_t *>(data + HIDDEN1_BIASES_OFFSET);
+  network.hidden1_weights = reinterpret_cast<const int8_t *>(data + HIDDEN1_WEIGHTS_OFFSET);
+  network.hidden2_biases = reinterpret_cast<const int32_t *>(data + HIDDEN2_BIASES_OFFSET);
+  network.hidden2_weights = reinterpret_cast<const int8_t *>(data + HIDDEN2_WEIGHTS_OFFSET);
+  network.output_bias = reinterpret_cast<const int32_t *>(data + OUTPUT_BIAS_OFFSET);
+  network.output_weights = reinterpret_cast<const int8_t *>(data + OUTPUT_WEIGHTS_OFFSET);
+
+#ifdef CPP_CLIENT_HAS_SIMD
+  if (__builtin_cpu_supports("avx2")) {
+    NNUE_SIMD = SIMD_AVX2;
+  } else if (__builtin_cpu_supports("sse4.1")) {
+    NNUE_SIMD = SIMD_SSE41;
+  }
+#endif
+  USE_NNUE = true;
+  return true;
+}
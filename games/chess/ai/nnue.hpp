@@ -0,0 +1,69 @@
+//////////////////////////////////////////////////////////////////////
+/// @file nnue.hpp
+/// @brief Efficiently updatable neural network evaluation
+//////////////////////////////////////////////////////////////////////
+
+#ifndef CPP_CLIENT_NNUE_HPP
+#define CPP_CLIENT_NNUE_HPP
+
+#include "bitboard.hpp"
+
+#include <cstdint>
+#include <string>
+
+// The network sees the board once from each player's side. Each input
+// is one of the player's king squares paired with a square and a
+// non-king piece on it (HalfKP), and only the ~30 inputs for the pieces
+// on the board are ever set. Each side's inputs go through the first
+// layer into an accumulator, which a move only changes by a few rows.
+// Both accumulators, the player to evaluate for first, then go through
+// clipped ReLU to two small int8 layers and a single output.
+const int NNUE_INPUTS = 64 * 10 * 64;   // King square * piece kind * square
+const int NNUE_HALF_DIMENSIONS = 256;   // Accumulator size, for one side
+const int NNUE_HIDDEN_DIMENSIONS = 32;  // Size of both int8 layers
+
+// First layer outputs for both sides of the board
+struct Accumulator {
+  int16_t values[2][NNUE_HALF_DIMENSIONS];  // Indexed by the side's player_id
+  int king_square[2];  // Where the side's king was when its values were worked out,
+                       // or NO_SQUARE if they haven't been yet
+};
+
+// Which kernels the network runs on. Set by nnue_load from what the CPU supports
+enum simd_level {
+  SIMD_NONE,
+  SIMD_SSE41,
+  SIMD_AVX2
+};
+extern simd_level NNUE_SIMD;
+
+// Set by nnue_load if it succeeds, after which
+// heuristic_eval() uses the network
+extern bool USE_NNUE;
+
+// Memory maps a network, or reads it in on Windows. Must be called before any State is created
+// File layout, little endian, with every array in row-major order:
+//   char magic[4] = "NNUE", uint32 version = 1,
+//   uint32 inputs, half dimensions, hidden dimensions, 44 bytes of padding
+//   int16 feature_biases[half], int16 feature_weights[inputs][half]
+//   int32 hidden1_biases[hidden], int8 hidden1_weights[hidden][2 * half]
+//   int32 hidden2_biases[hidden], int8 hidden2_weights[hidden][hidden]
+//   int32 output_bias, 28 bytes of padding, int8 output_weights[hidden]
+// @return false, leaving the network unused, if the file is missing or doesn't match
+bool nnue_load(const std::string &path);
+
+// Work out one side's accumulator from scratch, for its king's current square
+// @param pieces : the State's bitboards, indexed [player_id][piece_type]
+void nnue_refresh(Accumulator &accumulator, int side, const Bitboard pieces[2][6]);
+
+// Update both sides' accumulators for a non-king piece put on or taken off a square
+void nnue_add_piece(Accumulator &accumulator, int player_id, int type, int square);
+void nnue_remove_piece(Accumulator &accumulator, int player_id, int type, int square);
+
+// @param player_id : the side to score for, which needn't be the side to
+//                    move. heuristic_eval passes the searching player and
+//                    the search negates the result on the opponent's turns
+// @return strength of the player, in centipawns
+int nnue_evaluate(const Accumulator &accumulator, int player_id);
+
+#endif //CPP_CLIENT_NNUE_HPP
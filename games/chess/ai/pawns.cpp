@@ -0,0 +1,114 @@
+//////////////////////////////////////////////////////////////////////
+/// @file pawns.cpp
+/// @brief Pawn structure evaluation and the table that caches it
+//////////////////////////////////////////////////////////////////////
+
+#include "pawns.hpp"
+#include "weights.hpp"
+#include "evaltrace.hpp"
+
+// Moves every bit one rank towards the opponent's side
+static inline Bitboard shift_forward(Bitboard b, int player_id) {
+  return player_id == 0 ? shift_north(b) : shift_south(b);
+}
+
+// Every square in front of the bits, and the bits themselves
+static inline Bitboard fill_forward(Bitboard b, int player_id) {
+  if (player_id == 0) {
+    b |= b << 8;
+    b |= b << 16;
+    b |= b << 32;
+  } else {
+    b |= b >> 8;
+    b |= b >> 16;
+    b |= b >> 32;
+  }
+  return b;
+}
+
+// Every square on a file with one of the bits
+static inline Bitboard fill_files(Bitboard b) {
+  return fill_forward(b, 0) | fill_forward(b, 1);
+}
+
+static inline Bitboard adjacent(Bitboard b) {
+  return shift_east(b) | shift_west(b);
+}
+
+void evaluate_pawns(const Bitboard pawns[2], PawnEntry &entry) {
+  entry.midgame = 0;
+  entry.endgame = 0;
+
+  for (int player_id = 0; player_id < 2; player_id++) {
+    int opponent_id = 1 - player_id;
+    int sign = player_id == 0 ? 1 : -1;
+    Bitboard own = pawns[player_id];
+    Bitboard enemy = pawns[opponent_id];
+
+    // Squares behind the player's pawns, and in front of the opponent's
+    Bitboard own_rear_span = fill_forward(shift_forward(own, opponent_id), opponent_id);
+    Bitboard enemy_span = fill_forward(shift_forward(enemy, opponent_id), opponent_id);
+    Bitboard enemy_attacks = adjacent(shift_forward(enemy, opponent_id));
+
+    // Pawns with another of their own in front of them
+    Bitboard doubled = own & own_rear_span;
+
+    // Pawns with no pawns of their own on either side file
+    Bitboard isolated = own & ~adjacent(fill_files(own));
+
+    // Pawns that no pawn on a side file is level with or behind, so none can
+    // come up to defend them, and that can't advance without being taken
+    Bitboard supportable = fill_forward(adjacent(own), player_id);
+    Bitboard backward = own & ~supportable & ~isolated
+        & shift_forward(enemy_attacks, opponent_id);
+
+    // Pawns no enemy pawn can stop or take. Only the front one of doubled pawns counts
+    Bitboard passed = own & ~(enemy_span | adjacent(enemy_span)) & ~doubled;
+
+    int doubled_count = popcount(doubled);
+    int isolated_count = popcount(isolated);
+    int backward_count = popcount(backward);
+    entry.midgame -= sign * (doubled_count * DOUBLED_PENALTY[0]
+        + isolated_count * ISOLATED_PENALTY[0] + backward_count * BACKWARD_PENALTY[0]);
+    entry.endgame -= sign * (doubled_count * DOUBLED_PENALTY[1]
+        + isolated_count * ISOLATED_PENALTY[1] + backward_count * BACKWARD_PENALTY[1]);
+    TRACE(doubled, -sign * doubled_count);
+    TRACE(isolated, -sign * isolated_count);
+    TRACE(backward, -sign * backward_count);
+
+    while (passed) {
+      int rank = rank_of(pop_lsb(passed));
+      if (player_id == 1) rank = 7 - rank;
+      entry.midgame += sign * PASSED_MIDGAME[rank];
+      entry.endgame += sign * PASSED_ENDGAME[rank];
+      TRACE(passed[rank], sign);
+    }
+  }
+}
+
+int pawn_shield(int player_id, int king_square, Bitboard own_pawns) {
+  Bitboard files = square_bb(king_square) | adjacent(square_bb(king_square));
+  Bitboard first = shift_forward(files, player_id);
+  Bitboard shield = first | shift_forward(first, player_id);
+  int count = popcount(own_pawns & shield);
+  TRACE(shield, player_id == 0 ? count : -count);
+  return SHIELD_BONUS * count;
+}
+
+PawnHashTable::PawnHashTable() {
+  // Key 0 is a board with no pawns, which scores 0 anyway
+  for (auto &entry : m_entries) {
+    entry.key = 0;
+    entry.midgame = 0;
+    entry.endgame = 0;
+  }
+}
+
+const PawnEntry &PawnHashTable::probe(uint64_t key, const Bitboard pawns[2]) {
+  PawnEntry &entry = m_entries[key & (SIZE - 1)];
+  if (entry.key != key) {
+    entry.key = key;
+    evaluate_pawns(pawns, entry);
+  }
+  return entry;
+}
@@ -0,0 +1,48 @@
+//////////////////////////////////////////////////////////////////////
+/// @file pawns.hpp
+/// @brief Pawn structure evaluation and the table that caches it
+//////////////////////////////////////////////////////////////////////
+
+#ifndef CPP_CLIENT_PAWNS_HPP
+#define CPP_CLIENT_PAWNS_HPP
+
+#include "bitboard.hpp"
+
+#include <cstdint>
+
+// Doubled, isolated, backward and passed pawns, for white minus black.
+// These only depend on where the pawns are, so they're worked out
+// once per pawn structure and looked up by the pawn-only zobrist key
+struct PawnEntry {
+  uint64_t key;
+  int midgame;
+  int endgame;
+};
+
+// Fills in entry's scores from both players' pawns
+void evaluate_pawns(const Bitboard pawns[2], PawnEntry &entry);
+
+// Bonus for the player's pawns in front of their king. Depends on
+// where the king is, so it isn't cached with the rest
+// @return midgame bonus, in centipawns
+int pawn_shield(int player_id, int king_square, Bitboard own_pawns);
+
+// Pawns move rarely, so a search sees few pawn structures and this
+// small table hits nearly every time. A structure that lands on an
+// occupied entry just evicts it. Each thread has its own table,
+// so entries are plain structs instead of atomics
+class PawnHashTable {
+ public:
+  PawnHashTable();
+
+  // @param key : State::pawn_hash() of the position
+  // @return the entry for the pawns, evaluating them if they aren't stored
+  const PawnEntry &probe(uint64_t key, const Bitboard pawns[2]);
+
+ private:
+  static const int SIZE = 1 << 13;  // Power of two, so the key's low bits pick the entry
+
+  PawnEntry m_entries[SIZE];
+};
+
+#endif //CPP_CLIENT_PAWNS_HPP
@@ -0,0 +1,43 @@
+//////////////////////////////////////////////////////////////////////
+/// @file ponderer.cpp
+/// @brief Searches on the opponent's time
+//////////////////////////////////////////////////////////////////////
+
+#include "ponderer.hpp"
+
+Ponderer::Ponderer(HistoryTable *history_table, TranspositionTable *transposition_table,
+                   EvalCache *eval_cache)
+    : m_history_table(history_table), m_transposition_table(transposition_table), m_eval_cache(eval_cache),
+      m_stop(false),
+      m_predicted_reply(NO_ACTION), m_completed_depth(0), m_best_action(NO_ACTION) {}
+
+Ponderer::~Ponderer() {
+  stop();
+}
+
+void Ponderer::start(const State &state, const Action &predicted_reply) {
+  stop();
+  m_stop = false;
+  m_predicted_reply = predicted_reply;
+  m_completed_depth = 0;
+  m_best_action = NO_ACTION;
+  m_thread = std::thread(&Ponderer::ponder_loop, this, state.apply(predicted_reply));
+}
+
+void Ponderer::stop() {
+  m_stop = true;
+  if (m_thread.joinable()) m_thread.join();
+}
+
+void Ponderer::ponder_loop(State state) {
+  // Results are kept for when it's our turn in this position
+  m_transposition_table->new_search();
+  if (state.available_actions(state.get_active_player()).empty()) return;
+  AdversarialSearch search(m_history_table, m_transposition_table, m_eval_cache, &m_stop);
+  for (int depth = 1; depth < MAX_PLY and !m_stop; depth++) {
+    Action action = search.depth_limited_minimax_search(state, depth);
+    if (search.aborted()) break;
+    m_best_action = action;
+    m_completed_depth = depth;
+  }
+}
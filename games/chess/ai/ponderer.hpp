@@ -0,0 +1,62 @@
+//////////////////////////////////////////////////////////////////////
+/// @file ponderer.hpp
+/// @brief Searches on the opponent's time
+//////////////////////////////////////////////////////////////////////
+
+#ifndef CPP_CLIENT_PONDERER_HPP
+#define CPP_CLIENT_PONDERER_HPP
+
+#include "state.hpp"
+#include "adversarialsearch.hpp"
+#include "transposition.hpp"
+
+#include <atomic>
+#include <thread>
+
+// After we move, guess the opponent's reply from the principal variation
+// and search the position it leads to in the background. If the guess is
+// right, the transposition table is already full of the position's
+// results and the search can pick up where pondering left off. If not,
+// it's thrown away.
+//
+// The main thread goes back to waiting on the server while this runs,
+// and only touches the search tables again after calling stop().
+class Ponderer {
+ public:
+  Ponderer(HistoryTable *history_table, TranspositionTable *transposition_table,
+           EvalCache *eval_cache);
+
+  ~Ponderer();
+
+  // Start searching the state after the predicted reply. Returns immediately
+  // @param state : the position after our move
+  // @param predicted_reply : a legal action for the opponent in state
+  void start(const State &state, const Action &predicted_reply);
+
+  // Tell the search to give up and wait for it to finish
+  void stop();
+
+  bool is_running() const { return m_thread.joinable(); }
+
+  const Action &predicted_reply() const { return m_predicted_reply; }
+
+  // Deepest search completed and its best action. Only
+  // meaningful after stop(). 0 if none finished
+  int completed_depth() const { return m_completed_depth; }
+  const Action &best_action() const { return m_best_action; }
+
+ private:
+  void ponder_loop(State state);
+
+  HistoryTable *m_history_table;
+  TranspositionTable *m_transposition_table;
+  EvalCache *m_eval_cache;
+  std::thread m_thread;
+  std::atomic<bool> m_stop;
+
+  Action m_predicted_reply;
+  int m_completed_depth;
+  Action m_best_action;
+};
+
+#endif //CPP_CLIENT_PONDERER_HPP
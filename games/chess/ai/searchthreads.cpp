@@ -0,0 +1,46 @@
+//////////////////////////////////////////////////////////////////////
+/// @file searchthreads.cpp
+/// @brief Helper threads for lazy SMP parallel search
+//////////////////////////////////////////////////////////////////////
+
+#include "searchthreads.hpp"
+
+// Helpers don't need to go on forever if the main thread never stops them
+const int MAX_HELPER_DEPTH = 64;
+
+SearchThreads::SearchThreads(TranspositionTable *transposition_table, EvalCache *eval_cache)
+    : m_transposition_table(transposition_table), m_eval_cache(eval_cache), m_stop(false) {}
+
+SearchThreads::~SearchThreads() {
+  stop();
+}
+
+void SearchThreads::set_thread_count(int thread_count) {
+  stop();
+  m_history_tables.resize(thread_count > 1 ? thread_count - 1 : 0);
+}
+
+void SearchThreads::start(const State &state) {
+  stop();
+  m_stop = false;
+  for (int i = 0; i < int(m_history_tables.size()); i++) {
+    m_history_tables[i].age();
+    m_threads.push_back(std::thread(&SearchThreads::helper_loop, this, i, state));
+  }
+}
+
+void SearchThreads::stop() {
+  m_stop = true;
+  for (auto &thread : m_threads) thread.join();
+  m_threads.clear();
+}
+
+void SearchThreads::helper_loop(int helper_id, State state) {
+  AdversarialSearch search(&m_history_tables[helper_id], m_transposition_table, m_eval_cache, &m_stop);
+
+  // Every other helper starts one ply deeper than the main thread,
+  // so the helpers aren't all duplicating its work
+  for (int depth = 1 + helper_id % 2; depth <= MAX_HELPER_DEPTH and !m_stop; depth++) {
+    search.depth_limited_minimax_search(state, depth);
+  }
+}
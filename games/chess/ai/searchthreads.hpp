@@ -0,0 +1,47 @@
+//////////////////////////////////////////////////////////////////////
+/// @file searchthreads.hpp
+/// @brief Helper threads for lazy SMP parallel search
+//////////////////////////////////////////////////////////////////////
+
+#ifndef CPP_CLIENT_SEARCHTHREADS_HPP
+#define CPP_CLIENT_SEARCHTHREADS_HPP
+
+#include "state.hpp"
+#include "adversarialsearch.hpp"
+#include "transposition.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Lazy SMP: helper threads run their own iterative deepening on the
+// same position as the main search, with nothing shared but the
+// transposition table. They start at staggered depths, so they fill
+// the table with results the main thread reaches a moment later.
+// Only the main thread's answer is ever played.
+class SearchThreads {
+ public:
+  SearchThreads(TranspositionTable *transposition_table, EvalCache *eval_cache);
+
+  ~SearchThreads();
+
+  // Total threads searching, counting the main thread
+  void set_thread_count(int thread_count);
+
+  // Start the helpers on the state. Returns immediately
+  void start(const State &state);
+
+  // Tell the helpers to give up and wait for them to finish
+  void stop();
+
+ private:
+  void helper_loop(int helper_id, State state);
+
+  TranspositionTable *m_transposition_table;
+  EvalCache *m_eval_cache;
+  std::vector<HistoryTable> m_history_tables;  // One per helper, kept between turns
+  std::vector<std::thread> m_threads;
+  std::atomic<bool> m_stop;
+};
+
+#endif //CPP_CLIENT_SEARCHTHREADS_HPP
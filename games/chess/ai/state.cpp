@@ -5,7 +5,11 @@
 //////////////////////////////////////////////////////////////////////
 
 #include "state.hpp"
+#include "zobrist.hpp"
+#include "pst.hpp"
+#include "nnue.hpp"
 
+#include <algorithm>
 #include <map>
 #include <sstream>
 
@@ -13,156 +17,128 @@
 ///  Lookups for moves & state transitions
 //////////////////////////////////////////////////////////////////////
 
-// Vectors representing piece move offsets
-const std::vector<Space> KNIGHT_MOVES{
-    {2, 1},
-    {1, 2},
-    {-1, 2},
-    {-2, 1},
-    {-1, -2},
-    {-2, -1},
-    {1, -2},
-    {2, -1}
+const int POSSIBLE_PROMOTIONS[] = {
+    ACTION_PROMOTE_QUEEN,
+    ACTION_PROMOTE_BISHOP,
+    ACTION_PROMOTE_KNIGHT,
+    ACTION_PROMOTE_ROOK
 };
 
-// And all multiples
-const std::vector<Space> BISHOP_MOVES{
-    {-1, -1},
-    {-1, 1},
-    {1, -1},
-    {1, 1}
-};
-
-const std::vector<Space> ROOK_MOVES{
-    {1, 0},
-    {-1, 0},
-    {0, 1},
-    {0, -1}
-};
-
-// King and Queen can move the same directions, just different amounts
-const std::vector<Space> ROYAL_MOVES{
-    {-1, -1},
-    {-1, 1},
-    {1, -1},
-    {1, 1},
-    {1, 0},
-    {-1, 0},
-    {0, 1},
-    {0, -1}
-};
-
-const std::vector<std::string> POSSIBLE_PROMOTIONS{
-    "Queen",
-    "Bishop",
-    "Knight",
-    "Rook"
-};
-
-// Special values for Castling
-const Space WHITE_KINGSIDE_ROOK_START = {0, 7};
-
-const Space WHITE_KINGSIDE_ROOK_CASTLED = {0, 5};
-
-const Space WHITE_QUEENSIDE_ROOK_START = {0, 0};
-
-const Space WHITE_QUEENSIDE_ROOK_CASTLED = {0, 3};
-
-const Space BLACK_KINGSIDE_ROOK_START = {7, 7};
-
-const Space BLACK_KINGSIDE_ROOK_CASTLED = {7, 5};
-
-const Space BLACK_QUEENSIDE_ROOK_START = {7, 0};
-
-const Space BLACK_QUEENSIDE_ROOK_CASLTED = {7, 3};
-
-const Space NO_EN_PASSANT = {-1, -1};
+// Squares that must be empty to castle, accessed as [player_id]
+const Bitboard KINGSIDE_CASTLE_PATH[] = {0x60ULL, 0x60ULL << 56};
+const Bitboard QUEENSIDE_CASTLE_PATH[] = {0x0EULL, 0x0EULL << 56};
 
 // Accessed as PAWN_START_RANK[player_id]
 const int PAWN_START_RANK[] = {1, 6};
+const int PAWN_PROMOTION_RANK[] = {7, 0};
+const int PAWN_FORWARD[] = {8, -8};
+
+// Inverse of PIECE_CODES for an uppercase piece code
+static int type_of(char code) {
+  for (int type = PAWN; type < NO_PIECE_TYPE; type++) {
+    if (PIECE_CODES[type] == code) return type;
+  }
+  assert(false);
+  return NO_PIECE_TYPE;
+}
 
 //////////////////////////////////////////////////////////////////////
 ///  Class Implementation
 //////////////////////////////////////////////////////////////////////
 
+State::State()
+    : m_active_player(0),
+      m_pieces(),
+      m_occupancy(),
+      m_castling_status{CASTLE_NONE, CASTLE_NONE},
+      m_en_passant(NO_SQUARE),
+      m_last_move(NO_SQUARE),
+      m_hash(0),
+      m_pawn_hash(0),
+      m_midgame{0, 0},
+      m_endgame{0, 0},
+      m_phase(0) {
+  for (auto &piece : m_board) piece = NO_PIECE;
+  m_accumulator.king_square[0] = NO_SQUARE;
+  m_accumulator.king_square[1] = NO_SQUARE;
+}
+
 State::State(const cpp_client::chess::Game &game)
-    : m_collision_map() {
+    : State() {
   m_active_player = game->current_player->id[0] - '0';
   assert(m_active_player == 0 or m_active_player == 1);
 
   // Read in pieces
   for (const auto &piece: game->pieces) {
-    PieceModel piecemodel(piece);
-    int rank = piecemodel.location.rank;
-    int file = piecemodel.location.file;
-
     int piece_owner = piece->owner->id[0] - '0';
-    m_player_pieces[piece_owner].push_back(piecemodel);
-
-    char piece_code = PIECE_CODE_LOOKUP[piece->type];
-    if (piece_owner == 1) piece_code = char(tolower(piece_code));
-    m_collision_map[rank][file] = piece_code;
+    // Convert location to 0-indexed
+    int square = make_square(piece->rank - 1, piece->file[0] - 'a');
+    put_piece(piece_owner, type_of(PIECE_CODE_LOOKUP[piece->type]), square);
   }
 
   // Read in castling status and En Passant from FEN
   std::istringstream fen(game->fen);
-  std::string piece_placement, active_color, castling_status, en_passant, clock, move;
-  fen >> piece_placement >> active_color >> castling_status >> en_passant >> clock >> move;
-
-  if (castling_status.find('K') != std::string::npos) {
-    m_castling_status[0] = CASTLE_KINGSIDE;
-  }
-  if (castling_status.find('Q') != std::string::npos) {
-    if (m_castling_status[0] == CASTLE_KINGSIDE) m_castling_status[0] = CASTLE_BOTH;
-    else m_castling_status[0] = CASTLE_QUEENSIDE;
-  }
-  if (castling_status.find('k') != std::string::npos) {
-    m_castling_status[1] = CASTLE_KINGSIDE;
-  }
-  if (castling_status.find('q') != std::string::npos) {
-    if (m_castling_status[1] == CASTLE_KINGSIDE) m_castling_status[0] = CASTLE_BOTH;
-    else m_castling_status[1] = CASTLE_QUEENSIDE;
-  }
+  std::string piece_placement, active_color, castling_status, en_passant;
+  fen >> piece_placement >> active_color >> castling_status >> en_passant;
+  read_fen_status(castling_status.c_str(), en_passant.c_str());
+  m_hash = compute_hash();
+}
 
-  if (en_passant == "-") {
-    m_en_passant = NO_EN_PASSANT;
-  } else {
-    int file = en_passant[0] - 'a';
-    int rank = en_passant[1] - '1';
-    m_en_passant = {rank, file};
-  }
+State::State(const std::string &fen)
+    : State(fen.c_str()) {}
 
-  m_last_move = {-1, -1};
+// Skips to the start of the next space separated field
+static const char *next_field(const char *fen) {
+  while (*fen != '\0' and *fen != ' ') fen++;
+  while (*fen == ' ') fen++;
+  return fen;
 }
 
-std::vector<Action> State::available_actions(int player_id) const {
-
-  auto possible_actions = all_actions(player_id);
-  std::vector<Action> valid_actions;
+State::State(const char *fen)
+    : State() {
+  // Placement starts at a8 and works down the ranks
+  int rank = 7, file = 0;
+  for (; *fen != '\0' and *fen != ' '; fen++) {
+    char c = *fen;
+    if (c == '/') {
+      rank--;
+      file = 0;
+    } else if ('1' <= c and c <= '8') {
+      file += c - '0';
+    } else {
+      int player_id = islower(c) ? 1 : 0;
+      put_piece(player_id, type_of(char(toupper(c))), make_square(rank, file));
+      file++;
+    }
+  }
 
-  // filter to actions that don't result in going into check
-  for (auto &action : possible_actions) {
-    // Castling moves can't take you out of or put you into check
-    if (action.m_piece.type == 'K'
-        && abs(action.m_space.rank - action.m_piece.location.rank) > 1) {
-      if (!in_check(player_id)) {
-        auto new_state = this->apply(action);
-        if (!new_state.in_check(player_id) == false) {
-          valid_actions.push_back(action);
-        }
-        valid_actions.push_back(action);
-      }
+  fen = next_field(fen);
+  m_active_player = *fen == 'b' ? 1 : 0;
+  const char *castling_status = next_field(fen);
+  read_fen_status(castling_status, next_field(castling_status));
+  m_hash = compute_hash();
+}
 
-    } else {
-      // Regular, non-castling moves just can't put you into check
-      auto new_state = this->apply(action);
-      if (new_state.in_check(player_id) == false) {
-        valid_actions.push_back(action);
-      }
+void State::read_fen_status(const char *castling_status, const char *en_passant) {
+  const char kingside_code[] = {'K', 'k'};
+  const char queenside_code[] = {'Q', 'q'};
+  for (int player_id = 0; player_id < 2; player_id++) {
+    int can_castle = CASTLE_NONE;
+    for (const char *c = castling_status; *c != '\0' and *c != ' '; c++) {
+      if (*c == kingside_code[player_id]) can_castle |= CASTLE_KINGSIDE;
+      if (*c == queenside_code[player_id]) can_castle |= CASTLE_QUEENSIDE;
     }
+    m_castling_status[player_id] = castling_status_type(can_castle);
   }
 
-  return valid_actions;
+  // "-" if there's no en passant square
+  if ('a' <= en_passant[0] and en_passant[0] <= 'h' and '1' <= en_passant[1] and en_passant[1] <= '8') {
+    int file = en_passant[0] - 'a';
+    int rank = en_passant[1] - '1';
+    m_en_passant = make_square(rank, file);
+  } else {
+    m_en_passant = NO_SQUARE;
+  }
 }
 
 State State::apply(const Action &action) const {
@@ -174,333 +150,310 @@ State State::apply(const Action &action) const {
   return copy;
 }
 
-bool State::in_check(int player_id) const {
-  Space king_location = {-1, -1};
-  for (const auto &piece: m_player_pieces[player_id]) {
-    if (piece.type == 'K') {
-      king_location = piece.location;
-      break;
-    }
+Undo State::make(const Action &action) {
+  int to = action.to();
+  Undo undo;
+  undo.captured = m_board[to];
+  if (action.flags() == ACTION_EN_PASSANT) {
+    undo.captured = m_board[to - PAWN_FORWARD[m_board[action.from()] / 6]];
   }
+  undo.castling_status[0] = m_castling_status[0];
+  undo.castling_status[1] = m_castling_status[1];
+  undo.en_passant = m_en_passant;
+  undo.last_move = m_last_move;
+  undo.hash = m_hash;
+  mutate(action);
+  return undo;
+}
+
+Undo State::make_null() {
+  Undo undo;
+  undo.captured = NO_PIECE;
+  undo.castling_status[0] = m_castling_status[0];
+  undo.castling_status[1] = m_castling_status[1];
+  undo.en_passant = m_en_passant;
+  undo.last_move = m_last_move;
+  undo.hash = m_hash;
+
+  // The en passant key depends on who's to move, so it comes out first
+  m_hash ^= en_passant_hash() ^ ZOBRIST_BLACK_TO_MOVE;
+  m_en_passant = NO_SQUARE;
+  m_last_move = NO_SQUARE;
+  m_active_player = (m_active_player == 0 ? 1 : 0);
+  return undo;
+}
 
-  //assert(king_location.rank != -1);
-  return space_threatened(king_location, 1 - player_id);
+void State::unmake_null(const Undo &undo) {
+  m_en_passant = undo.en_passant;
+  m_last_move = undo.last_move;
+  m_hash = undo.hash;
+  m_active_player = (m_active_player == 0 ? 1 : 0);
+}
+
+bool State::in_check(int player_id) const {
+  Bitboard king = m_pieces[player_id][KING];
+  if (king == 0) return false;
+  return space_threatened(lsb(king), 1 - player_id);
 }
 
 bool operator==(const State &lhs, const State &rhs) {
-  for (int i = 0; i < 8; i++) {
-    for (int j = 0; j < 8; j++) {
-      if (lhs.m_collision_map[i][j] != rhs.m_collision_map[i][j]) return false;
+  for (int player_id = 0; player_id < 2; player_id++) {
+    for (int type = PAWN; type < NO_PIECE_TYPE; type++) {
+      if (lhs.m_pieces[player_id][type] != rhs.m_pieces[player_id][type]) return false;
     }
   }
   return true;
 }
 
-std::vector<Action> State::all_actions(int player_id) const {
+ActionList State::available_actions(int player_id) const {
+  return generate_actions(player_id, false);
+}
+
+ActionList State::available_captures(int player_id) const {
+  return generate_actions(player_id, true);
+}
+
+ActionList State::generate_actions(int player_id, bool captures_only) const {
   assert(player_id == 0 or player_id == 1);
 
-  std::vector<Action> actions;
-  actions.reserve(40);
-
-  // maybe forward[player_id] would be better?
-  Space forward = {1, 0};
-  Space backward = {-1, 0};
-  if (player_id == 1) forward = {-1, 0};
-  if (player_id == 1) backward = {1, 0};
-
-  for (auto &piece : m_player_pieces[player_id]) {
-    if (piece.type == 'P') {
-      // Regular Moves
-      bool in_original_space = (piece.location.rank == PAWN_START_RANK[player_id]);
-      Space space_ahead = piece.location + forward;
-      bool can_promote = (space_ahead.rank == 7) or (space_ahead.rank == 0);
-      if (is_clear(space_ahead)) {
-        // Promotion
-        if (can_promote) {
-          for (auto &promotion_type : POSSIBLE_PROMOTIONS) {
-            actions.push_back(Action(piece, this, space_ahead, 0, promotion_type));
-          }
-        } else {
-          actions.push_back(Action(piece, this, space_ahead));
-          if (in_original_space and is_clear(space_ahead + forward)) {
-            actions.push_back(Action(piece, this, space_ahead + forward));
-          }
-        }
-      }
+  ActionList actions;
 
-      // Attacks
-      Space left = {0, -1}, right = {0, 1};
-      Space attack_spaces[] = {piece.location + forward + left,
-                               piece.location + forward + right};
-      for (int i = 0; i < 2; i++) {
-        if ((has_opponent_piece(attack_spaces[i], player_id))
-            or (attack_spaces[i] == m_en_passant
-                && has_opponent_piece(m_en_passant + backward, player_id))) {
-          char target = m_collision_map[attack_spaces[i].rank][attack_spaces[i].file];
-          if (attack_spaces[i] == m_en_passant) target = 'p';
-          assert(target != 0);
-          if (can_promote) {
-            for (auto &promotion_type : POSSIBLE_PROMOTIONS) {
-              actions.push_back(Action(piece, this, attack_spaces[i], target, promotion_type));
-            }
-          } else {
-            actions.push_back(Action(piece, this, attack_spaces[i], target));
-          }
-        }
-      }
-    } else if (piece.type == 'N') {
-      for (auto &offset : KNIGHT_MOVES) {
-        auto space = piece.location + offset;
-        if (is_clear(space) or has_opponent_piece(space, player_id)) {
-          char target = m_collision_map[space.rank][space.file];
-          actions.push_back(Action(piece, this, space, target));
-        }
-      }
-    } else if (piece.type == 'R') {
-      straight_line_moves(piece, ROOK_MOVES, player_id, actions);
-    } else if (piece.type == 'B') {
-      straight_line_moves(piece, BISHOP_MOVES, player_id, actions);
-    } else if (piece.type == 'Q') {
-      straight_line_moves(piece, ROYAL_MOVES, player_id, actions);
-    } else if (piece.type == 'K') {
-      for (auto &direction: ROYAL_MOVES) {
-        Space space = piece.location + direction;
-        if (is_clear(space) or has_opponent_piece(space, player_id)) {
-          char target = m_collision_map[space.rank][space.file];
-          actions.push_back(Action(piece, this, space, target));
-        }
-      }
+  int opponent_id = 1 - player_id;
+  Bitboard own = m_occupancy[player_id];
+  Bitboard occupied = own | m_occupancy[opponent_id];
+  int forward = PAWN_FORWARD[player_id];
 
-      //Castling is weird. I'll just hardcode all the locations
-      if (m_castling_status[player_id] != CASTLE_NONE) {
-        int rank = player_id == 0 ? 0 : 7;
-        char rook_code = player_id == 0 ? 'R' : 'r';
-        if (m_castling_status[player_id] == CASTLE_QUEENSIDE
-            or m_castling_status[player_id] == CASTLE_BOTH) {
-          bool clear_to_castle = true;
-          for (int file = 3; file > 0; file--) {
-            clear_to_castle &= is_clear(Space{rank, file});
-          }
-          if (m_collision_map[rank][0] != rook_code) clear_to_castle = false;
-          if (clear_to_castle) {
-            actions.push_back(Action(piece, this, {rank, 2}, 0, "", CASTLE_QUEENSIDE));
-          }
-        }
-        if (m_castling_status[player_id] == CASTLE_KINGSIDE
-            or m_castling_status[player_id] == CASTLE_BOTH) {
-          bool clear_to_castle = true;
-          for (int file = 5; file < 7; file++) {
-            clear_to_castle &= is_clear(Space{rank, file});
-          }
-          if (m_collision_map[rank][7] != rook_code) clear_to_castle = false;
-          if (clear_to_castle) {
-            actions.push_back(Action(piece, this, {rank, 6}, 0, "", CASTLE_KINGSIDE));
-          }
-        }
-      }
-    } else {
-      std::cout << "Warning: " << piece.parent->type << " moves not yet implemented." << std::endl;
-    }
-  }
-  return actions;
-}
+  // Squares pieces other than pawns are generated moving to
+  Bitboard target_mask = captures_only ? m_occupancy[opponent_id] : ~own;
 
-void State::mutate(const Action &action) {
-  // Debug: Assert loop invariant is satisfied
-  /*
-  for(const auto& piece : m_player_pieces[0])
-      assert(toupper(m_collision_map[piece.location.rank][piece.location.file]) == piece.type);
-  for(const auto& piece : m_player_pieces[1])
-      assert(toupper(m_collision_map[piece.location.rank][piece.location.file]) == piece.type);
-  */
-  // Update the board
-  int player_id = action.m_piece.parent->owner->id[0] - '0'; // This can be different from current player
-  // if we're checking for threatened squares
-  const Space &from = action.m_piece.location;
-  const Space &to = action.m_space;
-  m_collision_map[from.rank][from.file] = 0;
-  char piece_code = player_id == 0 ? action.m_piece.type : char(tolower(action.m_piece.type));
-  m_collision_map[to.rank][to.file] = piece_code;
-
-  // Update the moved piece in the list of player pieces
-  // Searching this list is O(n), but n is small and the alternative
-  // is introducing pointers that point to objects inside STL
-  // containers (could segfault), or making the containers themselves
-  // contain smart pointers and then defining a custom copy operation
-  // that's super careful to get all of the smart pointer objects
-  // deep copied.
-  //
-  // I don't feel like chasing memory leaks right now, so I'll take the hit and
-  // do the O(n) search operation. It's safe. I'll change it if the profiler
-  // starts complaining.
-  //
-  // I miss python. Why am I doing this to myself?
-  bool piece_moved = false;
-  for (auto &piece : m_player_pieces[player_id]) {
-    if (piece.location == action.m_piece.location) {
-      piece.location = action.m_space;
-      //assert(piece.type == action.m_piece.type);
-      piece_moved = true;
-      break;
+  Bitboard kings = m_pieces[player_id][KING];
+  if (kings == 0) return actions;
+  int king_square = lsb(kings);
+
+  // The king can't step onto an attacked square, including squares
+  // behind it on the line of a checking slider
+  Bitboard king_targets = KING_ATTACKS[king_square] & target_mask;
+  while (king_targets) {
+    int to = pop_lsb(king_targets);
+    if (!attackers_to(to, opponent_id, occupied ^ square_bb(king_square))) {
+      add_actions(king_square, square_bb(to), actions);
     }
   }
-  assert(piece_moved);
-
-  int opponent_id = (player_id == 0 ? 1 : 0);
-  if (action.m_target_piece != 0) {
-    if (action.m_space == m_en_passant) {
-      int rank = m_en_passant.rank > 4 ? 4 : 3;
-      Space true_location = {rank, action.m_space.file};
-      m_collision_map[true_location.rank][true_location.file] = 0;
-      remove_piece(opponent_id, true_location);
-    } else {
-      remove_piece(opponent_id, action.m_space);
-    }
+
+  // In double check only the king can move
+  Bitboard checkers = attackers_to(king_square, opponent_id, occupied);
+  if (popcount(checkers) > 1) return actions;
+
+  // Out of check, anything goes. In check, other pieces have to
+  // capture the checker or block the line between it and the king
+  Bitboard check_mask = ~0ULL;
+  if (checkers) check_mask = checkers | BETWEEN[king_square][lsb(checkers)];
+
+  // A pinned piece can only move along the line through it and the king
+  Bitboard pinned = pinned_pieces(player_id);
+  Bitboard allowed[64];
+  Bitboard pieces = own;
+  while (pieces) {
+    int from = pop_lsb(pieces);
+    allowed[from] = check_mask & ~own;
+    if (pinned & square_bb(from)) allowed[from] &= LINE[king_square][from];
   }
 
-  // Handle Pawn Promotion
-  if ((action.m_piece.type == 'p' or action.m_piece.type == 'P')
-      and action.m_promotion != "") {
-    for (auto &piece : m_player_pieces[player_id]) {
-      if (piece.location == action.m_piece.location) {
-        piece.type = PIECE_CODE_LOOKUP[action.m_promotion];
-        break;
+  Bitboard pawns = m_pieces[player_id][PAWN];
+  while (pawns) {
+    int from = pop_lsb(pawns);
+
+    // Regular Moves. Only promotions count when generating captures
+    Bitboard targets = 0;
+    int to = from + forward;
+    if (!(occupied & square_bb(to))
+        and (!captures_only or rank_of(to) == PAWN_PROMOTION_RANK[player_id])) {
+      targets |= square_bb(to);
+      if (rank_of(from) == PAWN_START_RANK[player_id] and !(occupied & square_bb(to + forward))) {
+        targets |= square_bb(to + forward);
       }
     }
-  }
 
-  // Apply Castling. Should already have been applied to the king, but we
-  // need to get the rook now, too.
-  if (action.m_castle != CASTLE_NONE) {
-    Space rook_start, rook_finish;
-    char rook_symbol = player_id == 0 ? 'R' : 'r';
-    assert(action.m_castle == CASTLE_KINGSIDE or action.m_castle == CASTLE_QUEENSIDE);
-    if (action.m_castle == CASTLE_KINGSIDE) {
-      rook_start = player_id == 0 ? WHITE_KINGSIDE_ROOK_START : BLACK_KINGSIDE_ROOK_START;
-      rook_finish = player_id == 0 ? WHITE_KINGSIDE_ROOK_CASTLED : BLACK_KINGSIDE_ROOK_CASTLED;
-    } else if (action.m_castle == CASTLE_QUEENSIDE) {
-      rook_start = player_id == 0 ? WHITE_QUEENSIDE_ROOK_START : BLACK_QUEENSIDE_ROOK_START;
-      rook_finish = player_id == 0 ? WHITE_QUEENSIDE_ROOK_CASTLED : BLACK_QUEENSIDE_ROOK_CASLTED;
+    // Attacks
+    targets |= PAWN_ATTACKS[player_id][from] & m_occupancy[opponent_id];
+    targets &= allowed[from];
+
+    while (targets) {
+      to = pop_lsb(targets);
+      int flags = m_board[to] == NO_PIECE ? ACTION_QUIET : ACTION_CAPTURE;
+      // Promotion
+      if (rank_of(to) == PAWN_PROMOTION_RANK[player_id]) {
+        for (auto promotion : POSSIBLE_PROMOTIONS) {
+          actions.push_back(Action(from, to, flags | promotion));
+        }
+      } else if (abs(to - from) == 16) {
+        actions.push_back(Action(from, to, ACTION_DOUBLE_PAWN_PUSH));
+      } else {
+        actions.push_back(Action(from, to, flags));
+      }
     }
 
-    // Update board
-    m_collision_map[rook_start.rank][rook_start.file] = 0;
-    m_collision_map[rook_finish.rank][rook_finish.file] = rook_symbol;
-
-    // Update piece in list
-    bool rook_moved = false;
-    for (auto &piece : m_player_pieces[player_id]) {
-      if (piece.location == rook_start) {
-        piece.location = rook_finish;
-        assert(piece.type == 'R');
-        rook_moved = true;
-        break;
+    // En passant removes two pieces from one line, which pin detection
+    // doesn't account for, so just check that the king is safe afterwards
+    if (m_en_passant != NO_SQUARE and (PAWN_ATTACKS[player_id][from] & square_bb(m_en_passant))) {
+      int captured = m_en_passant - forward;
+      Bitboard after = (occupied ^ square_bb(from) ^ square_bb(captured)) | square_bb(m_en_passant);
+      if (!(attackers_to(king_square, opponent_id, after) & ~square_bb(captured))) {
+        actions.push_back(Action(from, m_en_passant, ACTION_EN_PASSANT));
       }
     }
-    assert(rook_moved);
   }
 
-  // Debug: Assert loop invariant is satisfied
-  /*
-  for(const auto& piece : m_player_pieces[0])
-    assert(toupper(m_collision_map[piece.location.rank][piece.location.file]) == piece.type);
-  for(const auto& piece : m_player_pieces[1])
-    assert(toupper(m_collision_map[piece.location.rank][piece.location.file]) == piece.type);
-  */
-
-  // Check if the player can still castle
-  if (m_castling_status[player_id] != CASTLE_NONE) {
-    auto can_castle = m_castling_status[player_id];
-    bool king_moved = action.m_piece.type == 'K';
-    bool kingside_rook_moved, queenside_rook_moved;
-
-    // We can just check if the rooks are in their original spots
-    // If they moved away and back, castling status would have
-    // been disabled, so this is safe.
-    if (player_id == 0) {
-      kingside_rook_moved = m_collision_map[0][7] != 'R';
-      queenside_rook_moved = m_collision_map[0][0] != 'R';
-    } else {
-      kingside_rook_moved = m_collision_map[7][0] != 'r';
-      queenside_rook_moved = m_collision_map[7][7] != 'r';
+  Bitboard knights = m_pieces[player_id][KNIGHT];
+  while (knights) {
+    int from = pop_lsb(knights);
+    add_actions(from, KNIGHT_ATTACKS[from] & allowed[from] & target_mask, actions);
+  }
+
+  Bitboard rooks = m_pieces[player_id][ROOK];
+  while (rooks) {
+    int from = pop_lsb(rooks);
+    add_actions(from, rook_attacks(from, occupied) & allowed[from] & target_mask, actions);
+  }
+
+  Bitboard bishops = m_pieces[player_id][BISHOP];
+  while (bishops) {
+    int from = pop_lsb(bishops);
+    add_actions(from, bishop_attacks(from, occupied) & allowed[from] & target_mask, actions);
+  }
+
+  Bitboard queens = m_pieces[player_id][QUEEN];
+  while (queens) {
+    int from = pop_lsb(queens);
+    add_actions(from, queen_attacks(from, occupied) & allowed[from] & target_mask, actions);
+  }
+
+  // Castling status guarantees the king and rook haven't moved. The
+  // squares between them must be empty, and the king can't castle out
+  // of, through, or into check
+  if (!checkers and !captures_only) {
+    int rank = player_id == 0 ? 0 : 7;
+    if ((m_castling_status[player_id] & CASTLE_QUEENSIDE)
+        and !(occupied & QUEENSIDE_CASTLE_PATH[player_id])
+        and (m_pieces[player_id][ROOK] & square_bb(make_square(rank, 0)))
+        and !attackers_to(make_square(rank, 3), opponent_id, occupied)
+        and !attackers_to(make_square(rank, 2), opponent_id, occupied)) {
+      actions.push_back(Action(king_square, make_square(rank, 2), ACTION_CASTLE_QUEENSIDE));
     }
-    if (king_moved
-        or (kingside_rook_moved && (can_castle == CASTLE_KINGSIDE))
-        or (queenside_rook_moved && (can_castle == CASTLE_QUEENSIDE))) {
-      m_castling_status[player_id] = CASTLE_NONE;
-    } else if (can_castle == CASTLE_BOTH) {
-      if (kingside_rook_moved) m_castling_status[player_id] = CASTLE_QUEENSIDE;
-      if (queenside_rook_moved) m_castling_status[player_id] = CASTLE_KINGSIDE;
+    if ((m_castling_status[player_id] & CASTLE_KINGSIDE)
+        and !(occupied & KINGSIDE_CASTLE_PATH[player_id])
+        and (m_pieces[player_id][ROOK] & square_bb(make_square(rank, 7)))
+        and !attackers_to(make_square(rank, 5), opponent_id, occupied)
+        and !attackers_to(make_square(rank, 6), opponent_id, occupied)) {
+      actions.push_back(Action(king_square, make_square(rank, 6), ACTION_CASTLE_KINGSIDE));
     }
   }
+  return actions;
+}
+
+void State::mutate(const Action &action) {
+  int from = action.from();
+  int to = action.to();
+  int moving_piece = m_board[from];
+  assert(moving_piece != NO_PIECE);
+
+  // This can be different from current player
+  // if we're checking for threatened squares
+  int player_id = moving_piece / 6;
+  int type = moving_piece % 6;
+
+  // Take the old castling status and en passant out of the hash.
+  // The pieces are kept up to date by put_piece and remove_piece
+  m_hash ^= ZOBRIST_CASTLING[castling_index()] ^ en_passant_hash();
+
+  // Captures, including the pawn behind the en passant square
+  if (action.flags() == ACTION_EN_PASSANT) {
+    remove_piece(to - PAWN_FORWARD[player_id]);
+  } else if (action.is_capture()) {
+    remove_piece(to);
+  }
+
+  // Move the piece, handling Pawn Promotion
+  remove_piece(from);
+  if (action.is_promotion()) {
+    type = action.promotion_type();
+  }
+  put_piece(player_id, type, to);
+
+  // Apply Castling. The king has already moved,
+  // but we need to get the rook now, too.
+  if (action.castle() != CASTLE_NONE) {
+    int rank = rank_of(from);
+    int rook_start = make_square(rank, action.castle() == CASTLE_KINGSIDE ? 7 : 0);
+    int rook_finish = make_square(rank, action.castle() == CASTLE_KINGSIDE ? 5 : 3);
+    assert(m_board[rook_start] == player_id * 6 + ROOK);
+    remove_piece(rook_start);
+    put_piece(player_id, ROOK, rook_finish);
+  }
+
+  // Check if the players can still castle. Moving the king or
+  // moving or capturing a rook in its corner loses that right
+  Bitboard touched = square_bb(from) | square_bb(to);
+  for (int side = 0; side < 2; side++) {
+    int rank = side == 0 ? 0 : 7;
+    int can_castle = m_castling_status[side];
+    if (touched & square_bb(make_square(rank, 4))) can_castle = CASTLE_NONE;
+    if (touched & square_bb(make_square(rank, 7))) can_castle &= ~CASTLE_KINGSIDE;
+    if (touched & square_bb(make_square(rank, 0))) can_castle &= ~CASTLE_QUEENSIDE;
+    m_castling_status[side] = castling_status_type(can_castle);
+  }
 
   // Set up en passant target square for next move
-  if (action.m_piece.type == 'P'
-      and action.m_piece.location.rank == 1
-      and action.m_space.rank == 3) {
-    Space forward = {1, 0};
-    m_en_passant = action.m_piece.location + forward;
-    assert(m_collision_map[m_en_passant.rank][m_en_passant.file] == 0);
-  } else if (action.m_piece.type == 'P'
-      and action.m_piece.location.rank == 6
-      and action.m_space.rank == 4) {
-    Space forward = {-1, 0};
-    m_en_passant = action.m_piece.location + forward;
-    assert(m_collision_map[m_en_passant.rank][m_en_passant.file] == 0);
+  if (action.flags() == ACTION_DOUBLE_PAWN_PUSH) {
+    m_en_passant = (from + to) / 2;
   } else {
-    m_en_passant = NO_EN_PASSANT;
+    m_en_passant = NO_SQUARE;
   }
 
-  // Debug: Assert loop invariant is satisfied
-  /*
-  for (const auto &piece : m_player_pieces[0])
-    assert(toupper(m_collision_map[piece.location.rank][piece.location.file]) == piece.type);
-  for (const auto &piece : m_player_pieces[1])
-    assert(toupper(m_collision_map[piece.location.rank][piece.location.file]) == piece.type);
-  */
   // Swap active player
   m_active_player = (m_active_player == 0 ? 1 : 0);
 
-  // Update the hash value because the state has changed
-  m_last_move = action.m_space;
+  m_hash ^= ZOBRIST_BLACK_TO_MOVE ^ ZOBRIST_CASTLING[castling_index()] ^ en_passant_hash();
+
+  m_last_move = to;
 }
 
-bool State::is_clear(const Space &space) const {
-  if ((space.rank > 7) or (space.rank < 0)
-      or (space.file > 7) or (space.file < 0)) {
-    return false;
-  } else {
-    return m_collision_map[space.rank][space.file] == 0;
+void State::unmake(const Action &action, const Undo &undo) {
+  int from = action.from();
+  int to = action.to();
+  int moved_piece = m_board[to];
+  int player_id = moved_piece / 6;
+
+  // Promoted pieces go back as pawns
+  int type = action.is_promotion() ? PAWN : moved_piece % 6;
+  remove_piece(to);
+  put_piece(player_id, type, from);
+
+  if (action.castle() != CASTLE_NONE) {
+    int rank = rank_of(from);
+    int rook_start = make_square(rank, action.castle() == CASTLE_KINGSIDE ? 7 : 0);
+    int rook_finish = make_square(rank, action.castle() == CASTLE_KINGSIDE ? 5 : 3);
+    remove_piece(rook_finish);
+    put_piece(player_id, ROOK, rook_start);
   }
-}
 
-bool State::has_opponent_piece(Space space, int player_id) const {
-  if ((space.rank > 7) or (space.rank < 0)
-      or (space.file > 7) or (space.file < 0)) {
-    return false;
-  } else {
-    char piece_code = m_collision_map[space.rank][space.file];
-    // Black's pieces are lowercase, White's pieces are uppercase
-    if (player_id == 0) {
-      return (('a' <= piece_code) and (piece_code <= 'z'));
-    } else {
-      return (('A' <= piece_code) and (piece_code <= 'Z'));
-    }
+  if (undo.captured != NO_PIECE) {
+    int captured_square = action.flags() == ACTION_EN_PASSANT ? to - PAWN_FORWARD[player_id] : to;
+    put_piece(undo.captured / 6, undo.captured % 6, captured_square);
   }
+
+  m_castling_status[0] = undo.castling_status[0];
+  m_castling_status[1] = undo.castling_status[1];
+  m_en_passant = undo.en_passant;
+  m_last_move = undo.last_move;
+  m_hash = undo.hash;
+  m_active_player = (m_active_player == 0 ? 1 : 0);
 }
 
-void State::straight_line_moves(const PieceModel &piece, std::vector<Space> directions, int player_id,
-                                std::vector<Action> &actions) const {
-  for (auto &direction : directions) {
-    Space space = piece.location + direction;
-    while (true) {
-      if (is_clear(space) or has_opponent_piece(space, player_id)) {
-        char target_piece = m_collision_map[space.rank][space.file];
-        actions.push_back(Action(piece, this, space, target_piece));
-      }
-      if (!is_clear(space)) break;
-      space = space + direction;
-    }
+void State::add_actions(int from, Bitboard targets, ActionList &actions) const {
+  while (targets) {
+    int to = pop_lsb(targets);
+    actions.push_back(Action(from, to, m_board[to] == NO_PIECE ? ACTION_QUIET : ACTION_CAPTURE));
   }
 }
 
@@ -508,89 +461,132 @@ int State::get_active_player() const {
   return m_active_player;
 }
 
-void State::remove_piece(int player_id, const Space &location) {
-  // If the move takes a piece, delete it from the list
-  // The collision map doesn't store links,
-  // so we have to iterate through the opponent's pieces until we find the
-  // right one. In practice this isn't a problem because there are never more
-  // than 16 opponent pieces, which is a small number.
-  bool piece_taken = false;
-  for (int i = 0; i < m_player_pieces[player_id].size(); i++) {
-    auto &piece = m_player_pieces[player_id][i];
-    if (piece.location == location) {
-      // Delete the piece from the list
-      m_player_pieces[player_id].erase(m_player_pieces[player_id].begin() + i);
-      piece_taken = true;
-      break;
+void State::put_piece(int player_id, int type, int square) {
+  Bitboard b = square_bb(square);
+  m_pieces[player_id][type] |= b;
+  m_occupancy[player_id] |= b;
+  m_board[square] = uint8_t(player_id * 6 + type);
+  m_hash ^= ZOBRIST_HASH_TABLE[player_id * 6 + type][square];
+  if (type == PAWN) m_pawn_hash ^= ZOBRIST_HASH_TABLE[player_id * 6 + PAWN][square];
+
+  int index = pst_index(player_id, type, square);
+  m_midgame[player_id] += MIDGAME_VALUE[type] + MIDGAME_PST[index];
+  m_endgame[player_id] += ENDGAME_VALUE[type] + ENDGAME_PST[index];
+  m_phase += PHASE_WEIGHT[type];
+
+  // The network's inputs are relative to the king, so
+  // moving it means working out its side from scratch
+  if (USE_NNUE) {
+    if (type == KING) {
+      nnue_refresh(m_accumulator, player_id, m_pieces);
+    } else {
+      nnue_add_piece(m_accumulator, player_id, type, square);
     }
   }
-  assert(piece_taken);
 }
 
-bool State::space_threatened(Space space, int attacking_player) const {
-  char knight_code[] = {'N', 'n'};
-  char pawn_code[] = {'P', 'p'};
-  char rook_code[] = {'R', 'r'};
-  char bishop_code[] = {'B', 'b'};
-  char queen_code[] = {'Q', 'q'};
-  char king_code[] = {'K', 'k'};
-
-  Space PAWN_ATTACKS[2][2] = {
-      {{-1, 1}, {-1, -1}},
-      {{1, 1}, {1, -1}}
-  };
-
-  for (auto move: KNIGHT_MOVES) {
-    if (piece_at(space + move) == knight_code[attacking_player]) return true;
-  }
+void State::remove_piece(int square) {
+  int piece = m_board[square];
+  assert(piece != NO_PIECE);
+  Bitboard b = square_bb(square);
+  m_pieces[piece / 6][piece % 6] &= ~b;
+  m_occupancy[piece / 6] &= ~b;
+  m_board[square] = NO_PIECE;
+  m_hash ^= ZOBRIST_HASH_TABLE[piece][square];
+  if (piece % 6 == PAWN) m_pawn_hash ^= ZOBRIST_HASH_TABLE[piece][square];
+
+  int index = pst_index(piece / 6, piece % 6, square);
+  m_midgame[piece / 6] -= MIDGAME_VALUE[piece % 6] + MIDGAME_PST[index];
+  m_endgame[piece / 6] -= ENDGAME_VALUE[piece % 6] + ENDGAME_PST[index];
+  m_phase -= PHASE_WEIGHT[piece % 6];
+
+  if (USE_NNUE and piece % 6 != KING) nnue_remove_piece(m_accumulator, piece / 6, piece % 6, square);
+}
 
-  for (auto move: PAWN_ATTACKS[attacking_player]) {
-    if (piece_at(space + move) == pawn_code[attacking_player]) return true;
-  }
+Bitboard State::attackers_to(int square, int attacking_player, Bitboard occupied) const {
+  const Bitboard *pieces = m_pieces[attacking_player];
+  // A pawn attacks this square if it sits where an opposing
+  // pawn on this square would attack
+  return (PAWN_ATTACKS[1 - attacking_player][square] & pieces[PAWN])
+      | (KNIGHT_ATTACKS[square] & pieces[KNIGHT])
+      | (KING_ATTACKS[square] & pieces[KING])
+      | (bishop_attacks(square, occupied) & (pieces[BISHOP] | pieces[QUEEN]))
+      | (rook_attacks(square, occupied) & (pieces[ROOK] | pieces[QUEEN]));
+}
 
-  for (auto move: BISHOP_MOVES) {
-    auto space_considered = space + move;
-    char s = piece_at(space_considered);
-    if ((s == bishop_code[attacking_player])
-        || s == queen_code[attacking_player]
-        || s == king_code[attacking_player])
-      return true;
-    while (in_board(space_considered)) {
-      s = piece_at(space_considered);
-      if ((s == bishop_code[attacking_player])
-          || s == queen_code[attacking_player])
-        return true;
-      if (s != 0) break;
-      space_considered = space_considered + move;
-    }
+bool State::space_threatened(int square, int attacking_player) const {
+  return attackers_to(square, attacking_player, m_occupancy[0] | m_occupancy[1]) != 0;
+}
+
+// Cheapest first, so each side recaptures with its least valuable piece
+const int EXCHANGE_ORDER[] = {PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING};
+
+int State::static_exchange_eval(const Action &action) const {
+  int from = action.from();
+  int to = action.to();
+  int side = m_board[from] / 6;
+  Bitboard occupied = (m_occupancy[0] | m_occupancy[1]) ^ square_bb(from);
+
+  // gain[i] is what the side making capture i wins if the exchange stops there
+  int gain[32];
+  int depth = 0;
+  if (action.flags() == ACTION_EN_PASSANT) {
+    gain[0] = MATERIAL_VALUE[PAWN];
+    occupied ^= square_bb(to - PAWN_FORWARD[side]);
+  } else {
+    gain[0] = m_board[to] == NO_PIECE ? 0 : MATERIAL_VALUE[m_board[to] % 6];
+  }
+  int on_square = MATERIAL_VALUE[m_board[from] % 6];
+  if (action.is_promotion()) {
+    gain[0] += MATERIAL_VALUE[action.promotion_type()] - MATERIAL_VALUE[PAWN];
+    on_square = MATERIAL_VALUE[action.promotion_type()];
   }
 
-  for (auto move: ROOK_MOVES) {
-    auto space_considered = space + move;
-    char s = piece_at(space_considered);
-    if ((s == rook_code[attacking_player])
-        || s == queen_code[attacking_player]
-        || s == king_code[attacking_player])
-      return true;
-    while (in_board(space_considered)) {
-      s = piece_at(space_considered);
-      if ((s == rook_code[attacking_player])
-          || s == queen_code[attacking_player])
-        return true;
-      if (s != 0) break;
-      space_considered = space_considered + move;
+  // Take turns recapturing with the cheapest attacker. Sliders behind a
+  // piece that's been used join in, since it's gone from the occupancy
+  while (depth < 31) {
+    side = 1 - side;
+    Bitboard attackers = attackers_to(to, side, occupied) & occupied;
+    if (!attackers) break;
+    int type = PAWN;
+    for (int candidate : EXCHANGE_ORDER) {
+      if (attackers & m_pieces[side][candidate]) {
+        type = candidate;
+        break;
+      }
     }
-  }
+    // The king can only take last
+    if (type == KING and (attackers_to(to, 1 - side, occupied) & occupied)) break;
 
-  return false;
-}
+    depth++;
+    gain[depth] = on_square - gain[depth - 1];
+    on_square = MATERIAL_VALUE[type];
+    occupied ^= square_bb(lsb(attackers & m_pieces[side][type]));
+  }
 
-bool State::in_board(Space space) const {
-  return !((space.rank > 7) or (space.rank < 0)
-      or (space.file > 7) or (space.file < 0));
+  // Either side can stop capturing when carrying on would lose material
+  while (depth > 0) {
+    gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+    depth--;
+  }
+  return gain[0];
 }
 
-char State::piece_at(Space space) const {
-  if (in_board(space)) return m_collision_map[space.rank][space.file];
-  else return 0;
+Bitboard State::pinned_pieces(int player_id) const {
+  int opponent_id = 1 - player_id;
+  int king_square = lsb(m_pieces[player_id][KING]);
+  Bitboard occupied = m_occupancy[0] | m_occupancy[1];
+  const Bitboard *enemy = m_pieces[opponent_id];
+
+  // Enemy sliders that would see the king on an empty board
+  Bitboard snipers = (rook_attacks(king_square, 0) & (enemy[ROOK] | enemy[QUEEN]))
+      | (bishop_attacks(king_square, 0) & (enemy[BISHOP] | enemy[QUEEN]));
+
+  // Any of them with exactly one of our pieces in the way pins it
+  Bitboard pinned = 0;
+  while (snipers) {
+    Bitboard blockers = BETWEEN[king_square][pop_lsb(snipers)] & occupied;
+    if (popcount(blockers) == 1) pinned |= blockers & m_occupancy[player_id];
+  }
+  return pinned;
 }
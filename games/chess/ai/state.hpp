@@ -18,13 +18,36 @@
 #include "../../../joueur/src/attr_wrapper.hpp"
 
 #include "action.hpp"
+#include "actionlist.hpp"
+#include "bitboard.hpp"
+#include "nnue.hpp"
 #include <iostream>
 
+// Everything State::make overwrites that can't be
+// recomputed from the action itself
+struct Undo {
+  uint8_t captured;                          // Piece taken, as color * 6 + type, or NO_PIECE
+  castling_status_type castling_status[2];
+  int en_passant;
+  int last_move;
+  uint64_t hash;
+};
+
+// What each piece_type is worth to heuristic_eval()
+extern const int MATERIAL_VALUE[NO_PIECE_TYPE];
+
 class State {
  public:
   // Create a state from the chess game
   State(const cpp_client::chess::Game &game);
 
+  // Create a state from a position in Forsyth-Edwards Notation
+  State(const std::string &fen);
+
+  // Same, reading just the first four fields so anything can follow them,
+  // as in EPD lines. Doesn't allocate
+  State(const char *fen);
+
   // The default copy constructor is fine, no need to override
 
   // Generate all valid actions for the
@@ -33,11 +56,33 @@ class State {
   //                    1 for black
   // It's the user's responsibility to make sure it's actually
   // the player's turn.
-  std::vector<Action> available_actions(int player_id) const;
+  // Checks and pins are worked out once up front, so only
+  // legal actions are generated and none need to be tried out.
+  ActionList available_actions(int player_id) const;
+
+  // Just the legal captures and promotions out of available_actions(),
+  // for the quiescence search
+  ActionList available_captures(int player_id) const;
 
   // Returns a copy of the state with the given action applied
   State apply(const Action &action) const;
 
+  // Apply an action in place
+  // @return what's needed to take the action back with unmake()
+  Undo make(const Action &action);
+
+  // Take back an action applied by make()
+  // @pre action was the last action made on this state
+  //      and undo is what make() returned for it
+  void unmake(const Action &action, const Undo &undo);
+
+  // Pass the turn without moving, for null move pruning. Not a legal
+  // chess move, so the player to move mustn't be in check
+  // @return what's needed to take it back with unmake_null()
+  Undo make_null();
+
+  void unmake_null(const Undo &undo);
+
   // Tell if a player is in check
   // @param player_id : 0 for white
   //                    1 for black
@@ -45,23 +90,47 @@ class State {
 
   bool friend operator==(const State &lhs, const State &rhs);
 
-  long hash() const;
+  // Zobrist key of the pieces, side to move, castling status
+  // and en passant square. Kept up to date by make()/unmake()
+  uint64_t hash() const;
+
+  // Zobrist key of just the pawns, for the pawn hash table
+  uint64_t pawn_hash() const { return m_pawn_hash; }
 
   // Evaluates the strength of the specified player
   // @param player_id : 0 for white
   //                    1 for black
-  // @return strength, Higher numbers are better.
-  //                   Will never be lower than 0
+  // @return centipawns in the player's favour, negative if they're
+  //         behind. Comes from the network if one was loaded with nnue_load()
   int heuristic_eval(int player_id) const;
 
-  bool is_non_quiescent() const;
+  // Static exchange evaluation. Plays out every capture on the action's
+  // destination, each side taking with its cheapest attacker and
+  // stopping when that's better for them
+  // @return net MATERIAL_VALUE the player making the action wins,
+  //         negative if the exchange loses material
+  int static_exchange_eval(const Action &action) const;
 
   int get_active_player() const;
 
+  // The piece on a square, as color * 6 + type, or NO_PIECE
+  int piece_on(int square) const { return m_board[square]; }
+
+  // If the player has anything besides pawns and their king
+  bool has_non_pawn_material(int player_id) const {
+    return (m_occupancy[player_id] & ~m_pieces[player_id][PAWN] & ~m_pieces[player_id][KING]) != 0;
+  }
+
+  // Where the last action moved a piece to, or NO_SQUARE
+  int get_last_move() const { return m_last_move; }
+
  private:
-  // Calculates all actions allowed by traditional moves of chess
-  // Including actions that could put the player in check
-  std::vector<Action> all_actions(int player_id) const;
+  // Empty board, no castling, white to move
+  State();
+
+  // Read castling status and en passant from the FEN fields
+  // following the piece placement
+  void read_fen_status(const char *castling_status, const char *en_passant);
 
   // Apply an action in place
   // @param action must be a valid action generated by
@@ -70,46 +139,70 @@ class State {
   //        results in undefined behavior.
   //        It probably won't segfault, but anything
   //        else is on you.
-  // @post collision map, player's pieces,
-  //       castling status, en_passant status updated
+  // @post bitboards, mailbox, castling status,
+  //       en_passant status updated
   void mutate(const Action &action);
 
-  // Pretty self explanatory. No side effects.
-  bool is_clear(const Space &space) const;
-  bool has_opponent_piece(Space space, int player_id) const;
+  // Shared by available_actions() and available_captures()
+  ActionList generate_actions(int player_id, bool captures_only) const;
 
-  // Calculates moves in straight lines from the given piece
-  // Straight lines are defined as multiples of directions
-  // May move into an empty space or an opponent's piece
-  //
+  // Adds an action from the square to every square in targets
   // @post Moves added to actions
-  void straight_line_moves(const PieceModel &piece, std::vector<Space> directions, int player_id,
-                           std::vector<Action> &actions) const;
+  void add_actions(int from, Bitboard targets, ActionList &actions) const;
+
+  // Keep the bitboards, mailbox, zobrist keys and material in sync
+  void put_piece(int player_id, int type, int square);
+  void remove_piece(int square);
 
-  void remove_piece(int player_id, const Space &location);
+  // Recalculate the zobrist key from scratch
+  uint64_t compute_hash() const;
 
-  bool space_threatened(Space space, int attacking_player) const;
+  // Zobrist key for the en passant square, if it can be captured on
+  uint64_t en_passant_hash() const;
 
-  bool in_board(Space) const;
-  // Get type of piece at location, including bounds-checking
-  char piece_at(Space space) const;
+  int castling_index() const { return m_castling_status[0] | (m_castling_status[1] << 2); }
+
+  // All pieces of attacking_player that attack the square,
+  // with sliders blocked by the given occupancy
+  Bitboard attackers_to(int square, int attacking_player, Bitboard occupied) const;
+
+  // Pieces of player_id that are the only thing between
+  // their king and an enemy slider
+  Bitboard pinned_pieces(int player_id) const;
+
+  bool space_threatened(int square, int attacking_player) const;
 
   int m_active_player;
 
   // Arrays of 2 - one for each player
-  std::vector<PieceModel> m_player_pieces[2];      // The main data structure where pieces are stored.
+  Bitboard m_pieces[2][6];                         // One board per piece type, indexed by piece_type
+  Bitboard m_occupancy[2];                         // Union of each player's piece boards
   castling_status_type m_castling_status[2];       // If players can castle
-  Space m_en_passant;                              // Target space for en passant, if any
-
-  // Just for quick checks. All real operations are on the player pieces vector
-  // Contains piece codes with the same notation as used in the print_board example
-  // White pieces are uppercase, black pieces are lowercase
-  // A null character (0x00) is used for an empty space
-  char m_collision_map[8][8];
-
-  // Last place a piece moved to, used for quiescence checks
-  // Updated during state creation and mutation
-  Space m_last_move;
+  int m_en_passant;                                // Target square for en passant, or NO_SQUARE
+
+  // Piece on each square, as color * 6 + type, or NO_PIECE.
+  // Just for quick lookups of what's being captured.
+  // All move generation works on the bitboards
+  uint8_t m_board[64];
+
+  // Last place a piece moved to, which with the piece on it indexes
+  // the search's countermove table. NO_SQUARE at the start or after a null move
+  int m_last_move;
+
+  // Zobrist key, updated along with the board
+  uint64_t m_hash;
+  uint64_t m_pawn_hash;  // Same keys, but only for the pawns
+
+  // Each player's piece values plus piece-square table bonuses,
+  // and the game phase from the material left. Updated along
+  // with the board, so the heuristic doesn't have to add them up
+  int m_midgame[2];
+  int m_endgame[2];
+  int m_phase;
+
+  // The network's first layer for both sides, updated along
+  // with the board when heuristic_eval() uses the network
+  Accumulator m_accumulator;
 };
 
 #endif //CPP_CLIENT_STATE_HPP
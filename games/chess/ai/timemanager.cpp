@@ -0,0 +1,44 @@
+//////////////////////////////////////////////////////////////////////
+/// @file timemanager.cpp
+/// @brief Decides how long to search each turn
+//////////////////////////////////////////////////////////////////////
+
+#include "timemanager.hpp"
+
+#include <algorithm>
+
+// Moves we expect a game to last, and the fewest we'll
+// ever budget for so one move can't use up the clock
+const int EXPECTED_GAME_LENGTH = 60;
+const int MIN_MOVES_TO_GO = 10;
+
+// The hard limit is this many soft limits, and never
+// more than this fraction of what's left on the clock
+const double HARD_LIMIT_MULTIPLIER = 4.0;
+const double MAX_CLOCK_FRACTION = 0.1;
+
+// Seconds kept back for sending the move and network lag
+const double SAFETY_MARGIN = 0.05;
+
+TimeManager::TimeManager(double time_remaining, int current_turn)
+    : m_start(std::chrono::steady_clock::now()) {
+  double seconds = std::max(0.0, time_remaining / 1e9 - SAFETY_MARGIN);
+
+  // Turns count both players' moves. The draw counter isn't used to
+  // shorten the budget, since any capture or pawn move resets it
+  int moves_played = current_turn / 2;
+  int moves_to_go = std::max(MIN_MOVES_TO_GO, EXPECTED_GAME_LENGTH - moves_played);
+
+  m_soft_limit = seconds / moves_to_go;
+  m_hard_limit = std::min(seconds * MAX_CLOCK_FRACTION, m_soft_limit * HARD_LIMIT_MULTIPLIER);
+  m_soft_limit = std::min(m_soft_limit, m_hard_limit);
+}
+
+double TimeManager::elapsed() const {
+  std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - m_start;
+  return seconds.count();
+}
+
+void TimeManager::extend(double factor) {
+  m_soft_limit = std::min(m_soft_limit * factor, m_hard_limit);
+}
@@ -0,0 +1,40 @@
+//////////////////////////////////////////////////////////////////////
+/// @file timemanager.hpp
+/// @brief Decides how long to search each turn
+//////////////////////////////////////////////////////////////////////
+
+#ifndef CPP_CLIENT_TIMEMANAGER_HPP
+#define CPP_CLIENT_TIMEMANAGER_HPP
+
+#include <chrono>
+
+// Splits what's left of the clock over the moves expected to be left.
+// The soft limit is when to stop starting new iterations, and can be
+// extended when the search looks unsure. The hard limit is when to
+// give up on the iteration in progress.
+class TimeManager {
+ public:
+  // Starts the clock
+  // @param time_remaining : on our clock, in nanoseconds
+  // @param current_turn : turns played so far by both players
+  TimeManager(double time_remaining, int current_turn);
+
+  // Seconds since the clock started
+  double elapsed() const;
+
+  bool soft_limit_reached() const { return elapsed() >= m_soft_limit; }
+  bool hard_limit_reached() const { return elapsed() >= m_hard_limit; }
+
+  // Multiply the soft limit by factor, up to the hard limit
+  void extend(double factor);
+
+  double soft_limit() const { return m_soft_limit; }
+  double hard_limit() const { return m_hard_limit; }
+
+ private:
+  std::chrono::steady_clock::time_point m_start;
+  double m_soft_limit;  // Seconds
+  double m_hard_limit;  // Seconds
+};
+
+#endif //CPP_CLIENT_TIMEMANAGER_HPP
@@ -0,0 +1,123 @@
+//////////////////////////////////////////////////////////////////////
+/// @file transposition.cpp
+/// @brief Fixed-size transposition table for the adversarial search
+//////////////////////////////////////////////////////////////////////
+
+#include "transposition.hpp"
+
+#include <new>
+
+TranspositionTable::TranspositionTable(size_t megabytes)
+    : m_buckets(NULL), m_mask(0), m_age(0) {
+  resize(megabytes);
+}
+
+size_t table_entries(size_t megabytes, size_t entry_size) {
+  size_t entries = 1;
+  while (entries * 2 * entry_size <= megabytes * 1024 * 1024) entries *= 2;
+  return entries;
+}
+
+void TranspositionTable::resize(size_t megabytes) {
+  size_t buckets = table_entries(megabytes, sizeof(Bucket));
+
+  // new only guarantees fundamental alignment before C++17, so the
+  // buckets are constructed in place at the first aligned address
+  m_memory.reset(new char[buckets * sizeof(Bucket) + alignof(Bucket)]);
+  uintptr_t address = reinterpret_cast<uintptr_t>(m_memory.get());
+  address = (address + alignof(Bucket) - 1) & ~uintptr_t(alignof(Bucket) - 1);
+  m_buckets = reinterpret_cast<Bucket *>(address);
+  for (size_t i = 0; i < buckets; i++) new (&m_buckets[i]) Bucket();
+  m_mask = buckets - 1;
+  clear();
+}
+
+void TranspositionTable::clear() {
+  for (uint64_t i = 0; i <= m_mask; i++) {
+    for (auto &slot : m_buckets[i].slots) {
+      slot.key.store(0, std::memory_order_relaxed);
+      slot.data.store(0, std::memory_order_relaxed);
+    }
+  }
+  m_age = 0;
+}
+
+void TranspositionTable::new_search() {
+  m_age = (m_age + 1) & 63;
+}
+
+uint64_t TranspositionTable::pack(int score, int depth, bound_type bound, const Action &action, int age) {
+  if (depth < 0) depth = 0;
+  if (depth > 255) depth = 255;
+  return uint64_t(uint32_t(score))
+      | (uint64_t(action.hash() & 0xFFFF) << 32)
+      | (uint64_t(depth) << 48)
+      | (uint64_t(bound) << 56)
+      | (uint64_t(age) << 58);
+}
+
+Action TranspositionTable::unpack_action(uint64_t data) {
+  int action = int((data >> 32) & 0xFFFF);
+  return Action(action & 0x3F, (action >> 6) & 0x3F, action >> 12);
+}
+
+bool TranspositionTable::probe(uint64_t key, TTEntry &entry) const {
+  const Bucket &b = bucket(key);
+  for (const auto &slot : b.slots) {
+    uint64_t data = slot.data.load(std::memory_order_relaxed);
+    if ((slot.key.load(std::memory_order_relaxed) ^ data) == key and data != 0) {
+      entry.score = int32_t(uint32_t(data));
+      entry.best_action = unpack_action(data);
+      entry.depth = int((data >> 48) & 0xFF);
+      entry.bound = bound_type((data >> 56) & 3);
+      return true;
+    }
+  }
+  return false;
+}
+
+void TranspositionTable::store(uint64_t key, int score, int depth, bound_type bound, const Action &best_action) {
+  Bucket &b = bucket(key);
+  int age = m_age;
+
+  // Replace this position's old entry if it's there. Otherwise replace
+  // whichever entry is shallowest, counting older turns as shallower
+  Slot *replace = &b.slots[0];
+  uint64_t replace_data = 0;
+  bool same_position = false;
+  int replace_priority = INT32_MAX;
+  for (auto &slot : b.slots) {
+    uint64_t data = slot.data.load(std::memory_order_relaxed);
+    if ((slot.key.load(std::memory_order_relaxed) ^ data) == key) {
+      replace = &slot;
+      replace_data = data;
+      same_position = true;
+      break;
+    }
+    int slot_depth = int((data >> 48) & 0xFF);
+    int slot_age = int(data >> 58);
+    int priority = data == 0 ? -1 : slot_depth - 8 * ((age - slot_age) & 63);
+    if (priority < replace_priority) {
+      replace = &slot;
+      replace_data = data;
+      replace_priority = priority;
+    }
+  }
+
+  // Don't let a shallower search this turn overwrite a deeper one
+  if (same_position
+      and depth < int((replace_data >> 48) & 0xFF)
+      and int(replace_data >> 58) == age) {
+    return;
+  }
+
+  // Keep the old best action if this search didn't find one
+  Action action = best_action;
+  if (same_position and action == NO_ACTION) {
+    action = unpack_action(replace_data);
+  }
+
+  uint64_t data = pack(score, depth, bound, action, age);
+  replace->key.store(key ^ data, std::memory_order_relaxed);
+  replace->data.store(data, std::memory_order_relaxed);
+}
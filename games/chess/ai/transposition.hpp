@@ -0,0 +1,86 @@
+//////////////////////////////////////////////////////////////////////
+/// @file transposition.hpp
+/// @brief Fixed-size transposition table for the adversarial search
+//////////////////////////////////////////////////////////////////////
+
+#ifndef CPP_CLIENT_TRANSPOSITION_HPP
+#define CPP_CLIENT_TRANSPOSITION_HPP
+
+#include "action.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// How a stored score relates to the true value of the position
+enum bound_type {
+  BOUND_NONE,
+  BOUND_UPPER,   // Search failed low, true value is at most the score
+  BOUND_LOWER,   // Search failed high, true value is at least the score
+  BOUND_EXACT
+};
+
+struct TTEntry {
+  int score;
+  int depth;
+  bound_type bound;
+  Action best_action;  // NO_ACTION if none was found
+};
+
+// The most entries of entry_size bytes that fit in megabytes, rounded
+// down to a power of two so a key's low bits can pick the entry
+size_t table_entries(size_t megabytes, size_t entry_size);
+
+// Buckets are one cache line of four entries each, and there is a
+// power of two of them so the key's low bits pick the bucket.
+// Each entry is a packed data word and the key XORed with it.
+//
+// Search threads share one table without locking. Two threads writing
+// the same slot at once can leave one's key with the other's data, but
+// then the XOR no longer gives back the key and probe() ignores it.
+class TranspositionTable {
+ public:
+  TranspositionTable(size_t megabytes);
+
+  // Throws away everything stored and reallocates
+  void resize(size_t megabytes);
+
+  void clear();
+
+  // Call once per turn. Entries from older turns are
+  // replaced before entries from this one
+  void new_search();
+
+  // @return true and fills entry if the key is stored
+  bool probe(uint64_t key, TTEntry &entry) const;
+
+  void store(uint64_t key, int score, int depth, bound_type bound, const Action &best_action);
+
+ private:
+  static const int BUCKET_SIZE = 4;
+
+  // Relaxed atomics compile to plain loads and stores, but make
+  // the racing reads and writes well defined
+  struct Slot {
+    std::atomic<uint64_t> key;   // The position's key XOR data
+    std::atomic<uint64_t> data;  // score (32 bits), action (16), depth (8), bound (2), age (6)
+  };
+
+  // One cache line
+  struct alignas(64) Bucket {
+    Slot slots[BUCKET_SIZE];
+  };
+
+  static uint64_t pack(int score, int depth, bound_type bound, const Action &action, int age);
+
+  static Action unpack_action(uint64_t data);
+
+  Bucket &bucket(uint64_t key) const { return m_buckets[key & m_mask]; }
+
+  std::unique_ptr<char[]> m_memory;  // Over-allocated so buckets can be cache line aligned
+  Bucket *m_buckets;
+  uint64_t m_mask;
+  std::atomic<int> m_age;
+};
+
+#endif //CPP_CLIENT_TRANSPOSITION_HPP
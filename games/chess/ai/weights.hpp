@@ -0,0 +1,44 @@
+//////////////////////////////////////////////////////////////////////
+/// @file weights.hpp
+/// @brief Weights for the heuristic, generated by chess-tuner
+//////////////////////////////////////////////////////////////////////
+
+#ifndef CPP_CLIENT_WEIGHTS_HPP
+#define CPP_CLIENT_WEIGHTS_HPP
+
+// Regenerate with chess-tuner rather than editing by hand.
+// Picked by hand, not yet tuned
+
+// Percent of the piece's value
+const int WEIGHT_GUARD_OWN_PIECES = 5;
+const int WEIGHT_PIECES_CAN_CAPTURE = 3;
+
+// Centipawns, as {midgame, endgame}
+const int DOUBLED_PENALTY[2] = {11, 56};
+const int ISOLATED_PENALTY[2] = {5, 15};
+const int BACKWARD_PENALTY[2] = {9, 24};
+
+// Centipawns, by rank counted from the player's side of the board
+const int PASSED_MIDGAME[8] = {0, 0, 5, 10, 20, 35, 60, 0};
+const int PASSED_ENDGAME[8] = {0, 5, 10, 20, 40, 70, 110, 0};
+
+// Centipawns per pawn in front of the king, midgame only
+const int SHIELD_BONUS = 10;
+
+// Centipawns per square a piece attacks that isn't held by its own side
+// or guarded by enemy pawns, as {midgame, endgame}
+const int KNIGHT_MOBILITY[2] = {4, 4};
+const int BISHOP_MOBILITY[2] = {5, 5};
+const int ROOK_MOBILITY[2] = {2, 4};
+const int QUEEN_MOBILITY[2] = {1, 2};
+
+// Centipawns per attack on the enemy king or a square next to it, midgame only
+const int KNIGHT_KING_ATTACK = 8;
+const int BISHOP_KING_ATTACK = 6;
+const int ROOK_KING_ATTACK = 8;
+const int QUEEN_KING_ATTACK = 12;
+
+// Centipawns per enemy piece attacked and not defended, as {midgame, endgame}
+const int HANGING_PIECE[2] = {15, 25};
+
+#endif //CPP_CLIENT_WEIGHTS_HPP
@@ -3,11 +3,13 @@
 #ifndef CPP_CLIENT_ZOBRIST_HPP
 #define CPP_CLIENT_ZOBRIST_HPP
 
-#include <map>
+#include <cstdint>
 
-extern long ZOBRIST_HASH_TABLE[8][8][12];
-
-extern const std::map<char, int> HASH_INDICES;
+// Global hash tables. Must be initialized with init_zobrist_hash_table
+extern uint64_t ZOBRIST_HASH_TABLE[12][64];   // Accessed as [color * 6 + piece_type][square]
+extern uint64_t ZOBRIST_CASTLING[16];         // Accessed as [white status | black status << 2]
+extern uint64_t ZOBRIST_EN_PASSANT[8];        // Accessed as [file]
+extern uint64_t ZOBRIST_BLACK_TO_MOVE;
 
 void init_zobrist_hash_table();
 
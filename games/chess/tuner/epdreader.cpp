@@ -0,0 +1,107 @@
+//////////////////////////////////////////////////////////////////////
+/// @file epdreader.cpp
+/// @brief Streams lines of a large position file through a fixed buffer
+//////////////////////////////////////////////////////////////////////
+
+#include "epdreader.hpp"
+
+#include <cstring>
+#include <iostream>
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+// Position files can be past 2GB, which fseek and ftell's long can't
+// reach on every platform, so these go through the 64-bit versions
+static int seek(FILE *file, long long offset, int origin) {
+#ifdef _WIN32
+  return _fseeki64(file, offset, origin);
+#else
+  return fseeko(file, off_t(offset), origin);
+#endif
+}
+
+static long long tell(FILE *file) {
+#ifdef _WIN32
+  return _ftelli64(file);
+#else
+  return ftello(file);
+#endif
+}
+
+EpdReader::EpdReader(const std::string &path, long long begin, long long end)
+    : m_file(fopen(path.c_str(), "rb")),
+      m_buffer(new char[BUFFER_SIZE + 1]),
+      m_begin(0),
+      m_size(0),
+      m_position(begin),
+      m_end(end),
+      m_eof(false) {
+  if (m_file == NULL or begin == 0) return;
+
+  // A line that starts before begin belongs to whoever reads the range before
+  seek(m_file, begin - 1, SEEK_SET);
+  int c;
+  m_position = begin - 1;
+  do {
+    c = fgetc(m_file);
+    m_position++;
+  } while (c != '\n' and c != EOF);
+  m_eof = c == EOF;
+}
+
+EpdReader::~EpdReader() {
+  if (m_file != NULL) fclose(m_file);
+}
+
+int EpdReader::next_batch(const char *lines[], int max_lines) {
+  if (m_file == NULL) return 0;
+
+  // The last batch is done with, so make room after what's left of the buffer
+  std::memmove(m_buffer.get(), m_buffer.get() + m_begin, m_size - m_begin);
+  m_position += m_begin;
+  m_size -= m_begin;
+  m_begin = 0;
+
+  int count = 0;
+  while (count < max_lines and m_position + (long long)m_begin < m_end) {
+    char *line = m_buffer.get() + m_begin;
+    char *newline = static_cast<char *>(std::memchr(line, '\n', m_size - m_begin));
+
+    if (newline == NULL and not m_eof) {
+      // Refilling would move lines already handed out, so leave it for next time
+      if (count > 0) break;
+      if (m_size == BUFFER_SIZE) {
+        std::cerr << "Line longer than " << BUFFER_SIZE << " bytes, stopping" << std::endl;
+        return 0;
+      }
+      size_t read = fread(m_buffer.get() + m_size, 1, BUFFER_SIZE - m_size, m_file);
+      m_size += read;
+      m_eof = read == 0;
+      continue;
+    }
+
+    if (newline == NULL) {
+      // Last line, with no line ending
+      if (m_begin == m_size) break;
+      newline = m_buffer.get() + m_size;
+    }
+    *newline = '\0';
+    if (newline > line and newline[-1] == '\r') newline[-1] = '\0';
+    lines[count++] = line;
+
+    // The last line's terminator can be past the end of the data
+    size_t next = size_t(newline - m_buffer.get()) + 1;
+    m_begin = next < m_size ? next : m_size;
+  }
+  return count;
+}
+
+long long EpdReader::file_size(const std::string &path) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == NULL) return -1;
+  seek(file, 0, SEEK_END);
+  long long size = tell(file);
+  fclose(file);
+  return size;
+}
@@ -0,0 +1,45 @@
+//////////////////////////////////////////////////////////////////////
+/// @file epdreader.hpp
+/// @brief Streams lines of a large position file through a fixed buffer
+//////////////////////////////////////////////////////////////////////
+
+#ifndef CPP_CLIENT_EPDREADER_HPP
+#define CPP_CLIENT_EPDREADER_HPP
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+// Reads the lines that start in a range of bytes of a file. Each
+// thread can take its own range of one file, and every line is read
+// by exactly one of them. Nothing is allocated after construction,
+// however large the file is.
+class EpdReader {
+ public:
+  // @param begin, end : byte offsets, end being past the last line to read
+  EpdReader(const std::string &path, long long begin, long long end);
+  ~EpdReader();
+
+  bool is_open() const { return m_file != NULL; }
+
+  // Reads up to max_lines lines, without their line endings
+  // @return how many were read, 0 once the range is done. The
+  //         lines are only valid until the next call
+  int next_batch(const char *lines[], int max_lines);
+
+  // @return the file's size in bytes, or -1 if it can't be opened
+  static long long file_size(const std::string &path);
+
+ private:
+  static const size_t BUFFER_SIZE = 1 << 20;  // Longest line that can be read
+
+  FILE *m_file;
+  std::unique_ptr<char[]> m_buffer;  // One byte longer, for the last line's terminator
+  size_t m_begin;                    // Start of what hasn't been handed out yet
+  size_t m_size;                     // Bytes in the buffer
+  long long m_position;              // File offset of the buffer's first byte
+  long long m_end;
+  bool m_eof;
+};
+
+#endif //CPP_CLIENT_EPDREADER_HPP
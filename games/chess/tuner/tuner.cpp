@@ -0,0 +1,384 @@
+//////////////////////////////////////////////////////////////////////
+/// @file tuner.cpp
+/// @brief Tunes the heuristic's weights against the results of real games
+//////////////////////////////////////////////////////////////////////
+
+// Texel's method. Each position is labeled with the result of the game
+// it came from, and the eval is turned into an expected result with a
+// sigmoid. The weights in weights.hpp are then moved by gradient descent
+// to minimize the squared difference between the two.
+//
+// Every weight enters the eval linearly, so a position's eval under new
+// weights is the heuristic's eval plus the change in each weight times
+// how much the trace says it was used. The heuristic only has to run
+// once per position per pass, with the weights it was compiled with.
+//
+// Usage: chess-tuner positions.epd [--output weights.hpp] [--threads N]
+//                    [--iterations N] [--rate R]
+// Each line of positions.epd is a FEN followed by the game's result,
+// as "1-0", "0-1" or "1/2-1/2", or as [1.0], [0.5] or [0.0].
+
+#include "epdreader.hpp"
+#include "../ai/state.hpp"
+#include "../ai/zobrist.hpp"
+#include "../ai/bitboard.hpp"
+#include "../ai/weights.hpp"
+#include "../ai/evaltrace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// Every tuned weight, in the order of weights.hpp
+enum weight_index {
+  GUARD_OWN_PIECES,
+  PIECES_CAN_CAPTURE,
+  DOUBLED_MIDGAME,
+  DOUBLED_ENDGAME,
+  ISOLATED_MIDGAME,
+  ISOLATED_ENDGAME,
+  BACKWARD_MIDGAME,
+  BACKWARD_ENDGAME,
+  PASSED_MIDGAME_0,
+  PASSED_ENDGAME_0 = PASSED_MIDGAME_0 + 8,
+  SHIELD = PASSED_ENDGAME_0 + 8,
+  MOBILITY_MIDGAME_0,  // One for each of MOBILE_PIECES
+  MOBILITY_ENDGAME_0 = MOBILITY_MIDGAME_0 + 4,
+  KING_ATTACK_0 = MOBILITY_ENDGAME_0 + 4,
+  HANGING_MIDGAME = KING_ATTACK_0 + 4,
+  HANGING_ENDGAME,
+  WEIGHT_COUNT
+};
+
+// Pieces with mobility and king attack weights, in the order of weights.hpp
+const piece_type MOBILE_PIECES[4] = {KNIGHT, BISHOP, ROOK, QUEEN};
+const char *const MOBILE_PIECE_NAMES[4] = {"KNIGHT", "BISHOP", "ROOK", "QUEEN"};
+const int *const MOBILITY_WEIGHTS[4] = {KNIGHT_MOBILITY, BISHOP_MOBILITY, ROOK_MOBILITY, QUEEN_MOBILITY};
+const int KING_ATTACK_WEIGHTS[4] = {KNIGHT_KING_ATTACK, BISHOP_KING_ATTACK, ROOK_KING_ATTACK, QUEEN_KING_ATTACK};
+
+const int BATCH_SIZE = 1024;          // Positions traced at a time by each thread
+const int DEFAULT_ITERATIONS = 200;
+const double DEFAULT_RATE = 1.0;      // Adam step size, in centipawns
+const int SAVE_INTERVAL = 10;         // Iterations between writing out the weights
+
+// Sigmoid scale is searched on a coarse grid, then a fine one around the best
+const int SCALE_STEPS = 21;
+const double COARSE_SCALE_STEP = 0.1;
+const double FINE_SCALE_STEP = 0.01;
+
+struct Options {
+  std::string positions;
+  std::string output = "games/chess/ai/weights.hpp";
+  int threads = int(std::thread::hardware_concurrency());
+  int iterations = DEFAULT_ITERATIONS;
+  double rate = DEFAULT_RATE;
+};
+
+// What one thread adds up over its share of a pass
+struct PassTotals {
+  long long positions = 0;
+  double error[SCALE_STEPS] = {};  // Squared error at each sigmoid scale tried
+  double gradient[WEIGHT_COUNT] = {};
+};
+
+static void initial_weights(double weights[WEIGHT_COUNT]) {
+  weights[GUARD_OWN_PIECES] = WEIGHT_GUARD_OWN_PIECES;
+  weights[PIECES_CAN_CAPTURE] = WEIGHT_PIECES_CAN_CAPTURE;
+  weights[DOUBLED_MIDGAME] = DOUBLED_PENALTY[0];
+  weights[DOUBLED_ENDGAME] = DOUBLED_PENALTY[1];
+  weights[ISOLATED_MIDGAME] = ISOLATED_PENALTY[0];
+  weights[ISOLATED_ENDGAME] = ISOLATED_PENALTY[1];
+  weights[BACKWARD_MIDGAME] = BACKWARD_PENALTY[0];
+  weights[BACKWARD_ENDGAME] = BACKWARD_PENALTY[1];
+  for (int rank = 0; rank < 8; rank++) {
+    weights[PASSED_MIDGAME_0 + rank] = PASSED_MIDGAME[rank];
+    weights[PASSED_ENDGAME_0 + rank] = PASSED_ENDGAME[rank];
+  }
+  weights[SHIELD] = SHIELD_BONUS;
+  for (int i = 0; i < 4; i++) {
+    weights[MOBILITY_MIDGAME_0 + i] = MOBILITY_WEIGHTS[i][0];
+    weights[MOBILITY_ENDGAME_0 + i] = MOBILITY_WEIGHTS[i][1];
+    weights[KING_ATTACK_0 + i] = KING_ATTACK_WEIGHTS[i];
+  }
+  weights[HANGING_MIDGAME] = HANGING_PIECE[0];
+  weights[HANGING_ENDGAME] = HANGING_PIECE[1];
+}
+
+// How much the eval changes per unit of each weight
+static void coefficients(const EvalTrace &trace, double c[WEIGHT_COUNT]) {
+  double midgame = double(trace.phase) / MAX_PHASE;
+  double endgame = 1 - midgame;
+  c[GUARD_OWN_PIECES] = trace.guard_own_pieces / 100.0;
+  c[PIECES_CAN_CAPTURE] = trace.pieces_can_capture / 100.0;
+  c[DOUBLED_MIDGAME] = trace.doubled * midgame;
+  c[DOUBLED_ENDGAME] = trace.doubled * endgame;
+  c[ISOLATED_MIDGAME] = trace.isolated * midgame;
+  c[ISOLATED_ENDGAME] = trace.isolated * endgame;
+  c[BACKWARD_MIDGAME] = trace.backward * midgame;
+  c[BACKWARD_ENDGAME] = trace.backward * endgame;
+  for (int rank = 0; rank < 8; rank++) {
+    c[PASSED_MIDGAME_0 + rank] = trace.passed[rank] * midgame;
+    c[PASSED_ENDGAME_0 + rank] = trace.passed[rank] * endgame;
+  }
+  c[SHIELD] = trace.shield * midgame;
+  for (int i = 0; i < 4; i++) {
+    c[MOBILITY_MIDGAME_0 + i] = trace.mobility[MOBILE_PIECES[i]] * midgame;
+    c[MOBILITY_ENDGAME_0 + i] = trace.mobility[MOBILE_PIECES[i]] * endgame;
+    c[KING_ATTACK_0 + i] = trace.king_attacks[MOBILE_PIECES[i]] * midgame;
+  }
+  c[HANGING_MIDGAME] = trace.hanging * midgame;
+  c[HANGING_ENDGAME] = trace.hanging * endgame;
+}
+
+// Finds the game result on an EPD line
+// @return false if there isn't one
+static bool parse_result(const char *line, double &result) {
+  const char *bracket = std::strchr(line, '[');
+  if (bracket != NULL) {
+    result = std::atof(bracket + 1);
+    return true;
+  }
+  if (std::strstr(line, "1/2-1/2") != NULL) {
+    result = 0.5;
+  } else if (std::strstr(line, "1-0") != NULL) {
+    result = 1.0;
+  } else if (std::strstr(line, "0-1") != NULL) {
+    result = 0.0;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Expected result for white from an eval in centipawns
+static double sigmoid(double eval, double scale) {
+  return 1.0 / (1.0 + std::pow(10.0, -scale * eval / 400.0));
+}
+
+// One thread's share of a pass over the positions
+// @param scales : sigmoid scales to measure the error at. The gradient is for the first
+static void run_pass(const Options &options, long long begin, long long end,
+                     const double delta[WEIGHT_COUNT], const double scales[SCALE_STEPS],
+                     int scale_count, PassTotals &totals) {
+  EpdReader reader(options.positions, begin, end);
+  const char *lines[BATCH_SIZE];
+  const char *fens[BATCH_SIZE];
+  double results[BATCH_SIZE];
+  int scores[BATCH_SIZE];
+  EvalTrace traces[BATCH_SIZE];
+
+  int count;
+  while ((count = reader.next_batch(lines, BATCH_SIZE)) > 0) {
+    int positions = 0;
+    for (int i = 0; i < count; i++) {
+      if (parse_result(lines[i], results[positions])) fens[positions++] = lines[i];
+    }
+    trace_eval_batch(fens, positions, scores, traces);
+
+    for (int i = 0; i < positions; i++) {
+      double c[WEIGHT_COUNT];
+      coefficients(traces[i], c);
+      double eval = scores[i];
+      for (int w = 0; w < WEIGHT_COUNT; w++) eval += c[w] * delta[w];
+
+      for (int s = 0; s < scale_count; s++) {
+        double difference = results[i] - sigmoid(eval, scales[s]);
+        totals.error[s] += difference * difference;
+      }
+
+      // d(error)/d(weight) = -2 * (result - sigmoid) * sigmoid' * coefficient
+      double expected = sigmoid(eval, scales[0]);
+      double slope = -2.0 * (results[i] - expected) * expected * (1.0 - expected)
+          * scales[0] * std::log(10.0) / 400.0;
+      for (int w = 0; w < WEIGHT_COUNT; w++) totals.gradient[w] += slope * c[w];
+    }
+    totals.positions += positions;
+  }
+}
+
+// Runs a pass split over every thread and adds up what they found
+static PassTotals pass(const Options &options, long long file_size, const double weights[WEIGHT_COUNT],
+                       const double initial[WEIGHT_COUNT], const double scales[SCALE_STEPS], int scale_count) {
+  double delta[WEIGHT_COUNT];
+  for (int w = 0; w < WEIGHT_COUNT; w++) delta[w] = weights[w] - initial[w];
+
+  std::vector<PassTotals> totals(options.threads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < options.threads; t++) {
+    long long begin = file_size * t / options.threads;
+    long long end = file_size * (t + 1) / options.threads;
+    threads.emplace_back(run_pass, std::cref(options), begin, end, delta, scales, scale_count,
+                         std::ref(totals[t]));
+  }
+  for (auto &thread : threads) thread.join();
+
+  PassTotals sum;
+  for (const PassTotals &t : totals) {
+    sum.positions += t.positions;
+    for (int s = 0; s < scale_count; s++) sum.error[s] += t.error[s];
+    for (int w = 0; w < WEIGHT_COUNT; w++) sum.gradient[w] += t.gradient[w];
+  }
+  return sum;
+}
+
+// The sigmoid scale that best fits the weights the heuristic was compiled with
+static double fit_scale(const Options &options, long long file_size, const double initial[WEIGHT_COUNT]) {
+  double best = 1.0;
+  double step = COARSE_SCALE_STEP;
+  double first = step;
+  for (int round = 0; round < 2; round++) {
+    double scales[SCALE_STEPS];
+    for (int s = 0; s < SCALE_STEPS; s++) scales[s] = first + s * step;
+    PassTotals totals = pass(options, file_size, initial, initial, scales, SCALE_STEPS);
+    int best_step = 0;
+    for (int s = 1; s < SCALE_STEPS; s++) {
+      if (totals.error[s] < totals.error[best_step]) best_step = s;
+    }
+    best = scales[best_step];
+    std::cout << "Sigmoid scale " << best << ", error " << totals.error[best_step] / totals.positions
+              << " over " << totals.positions << " positions" << std::endl;
+
+    // Search around it more finely
+    step = FINE_SCALE_STEP;
+    first = std::max(step, best - step * (SCALE_STEPS / 2));
+  }
+  return best;
+}
+
+static void write_weights(const std::string &path, const double weights[WEIGHT_COUNT],
+                          long long positions, double error) {
+  auto round = [](double weight) { return int(std::lround(weight)); };
+  auto pair = [&](int midgame, int endgame) {
+    return "{" + std::to_string(round(weights[midgame])) + ", " + std::to_string(round(weights[endgame])) + "}";
+  };
+  auto ranks = [&](int first) {
+    std::string s = "{";
+    for (int rank = 0; rank < 8; rank++) s += (rank ? ", " : "") + std::to_string(round(weights[first + rank]));
+    return s + "}";
+  };
+
+  std::string mobility, king_attacks;
+  for (int i = 0; i < 4; i++) {
+    std::string name = MOBILE_PIECE_NAMES[i];
+    mobility += "const int " + name + "_MOBILITY[2] = " + pair(MOBILITY_MIDGAME_0 + i, MOBILITY_ENDGAME_0 + i) + ";\n";
+    king_attacks += "const int " + name + "_KING_ATTACK = " + std::to_string(round(weights[KING_ATTACK_0 + i])) + ";\n";
+  }
+
+  std::ofstream out(path);
+  out << "//////////////////////////////////////////////////////////////////////\n"
+      << "/// @file weights.hpp\n"
+      << "/// @brief Weights for the heuristic, generated by chess-tuner\n"
+      << "//////////////////////////////////////////////////////////////////////\n"
+      << "\n"
+      << "#ifndef CPP_CLIENT_WEIGHTS_HPP\n"
+      << "#define CPP_CLIENT_WEIGHTS_HPP\n"
+      << "\n"
+      << "// Regenerate with chess-tuner rather than editing by hand.\n"
+      << "// Tuned on " << positions << " positions, mean squared error " << error << "\n"
+      << "\n"
+      << "// Percent of the piece's value\n"
+      << "const int WEIGHT_GUARD_OWN_PIECES = " << round(weights[GUARD_OWN_PIECES]) << ";\n"
+      << "const int WEIGHT_PIECES_CAN_CAPTURE = " << round(weights[PIECES_CAN_CAPTURE]) << ";\n"
+      << "\n"
+      << "// Centipawns, as {midgame, endgame}\n"
+      << "const int DOUBLED_PENALTY[2] = " << pair(DOUBLED_MIDGAME, DOUBLED_ENDGAME) << ";\n"
+      << "const int ISOLATED_PENALTY[2] = " << pair(ISOLATED_MIDGAME, ISOLATED_ENDGAME) << ";\n"
+      << "const int BACKWARD_PENALTY[2] = " << pair(BACKWARD_MIDGAME, BACKWARD_ENDGAME) << ";\n"
+      << "\n"
+      << "// Centipawns, by rank counted from the player's side of the board\n"
+      << "const int PASSED_MIDGAME[8] = " << ranks(PASSED_MIDGAME_0) << ";\n"
+      << "const int PASSED_ENDGAME[8] = " << ranks(PASSED_ENDGAME_0) << ";\n"
+      << "\n"
+      << "// Centipawns per pawn in front of the king, midgame only\n"
+      << "const int SHIELD_BONUS = " << round(weights[SHIELD]) << ";\n"
+      << "\n"
+      << "// Centipawns per square a piece attacks that isn't held by its own side\n"
+      << "// or guarded by enemy pawns, as {midgame, endgame}\n"
+      << mobility
+      << "\n"
+      << "// Centipawns per attack on the enemy king or a square next to it, midgame only\n"
+      << king_attacks
+      << "\n"
+      << "// Centipawns per enemy piece attacked and not defended, as {midgame, endgame}\n"
+      << "const int HANGING_PIECE[2] = " << pair(HANGING_MIDGAME, HANGING_ENDGAME) << ";\n"
+      << "\n"
+      << "#endif //CPP_CLIENT_WEIGHTS_HPP\n";
+}
+
+static bool parse_options(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--output" and has_value) {
+      options.output = argv[++i];
+    } else if (arg == "--threads" and has_value) {
+      options.threads = std::atoi(argv[++i]);
+    } else if (arg == "--iterations" and has_value) {
+      options.iterations = std::atoi(argv[++i]);
+    } else if (arg == "--rate" and has_value) {
+      options.rate = std::atof(argv[++i]);
+    } else if (options.positions.empty() and arg[0] != '-') {
+      options.positions = arg;
+    } else {
+      return false;
+    }
+  }
+  if (options.threads < 1) options.threads = 1;
+  return not options.positions.empty();
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  if (not parse_options(argc, argv, options)) {
+    std::cerr << "Usage: " << argv[0] << " positions.epd [--output weights.hpp] [--threads N]"
+              << " [--iterations N] [--rate R]" << std::endl;
+    return 1;
+  }
+  long long file_size = EpdReader::file_size(options.positions);
+  if (file_size < 0) {
+    std::cerr << "Couldn't open " << options.positions << std::endl;
+    return 1;
+  }
+
+  init_zobrist_hash_table();
+  init_bitboards();
+
+  double initial[WEIGHT_COUNT];
+  initial_weights(initial);
+  double scale = fit_scale(options, file_size, initial);
+
+  // Adam, which keeps each weight's steps about the same size
+  // however much it's used
+  const double beta1 = 0.9, beta2 = 0.999, epsilon = 1e-8;
+  double weights[WEIGHT_COUNT], momentum[WEIGHT_COUNT] = {}, velocity[WEIGHT_COUNT] = {};
+  std::memcpy(weights, initial, sizeof(weights));
+
+  for (int iteration = 1; iteration <= options.iterations; iteration++) {
+    auto start = std::chrono::steady_clock::now();
+    PassTotals totals = pass(options, file_size, weights, initial, &scale, 1);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double error = totals.error[0] / totals.positions;
+
+    for (int w = 0; w < WEIGHT_COUNT; w++) {
+      double gradient = totals.gradient[w] / totals.positions;
+      momentum[w] = beta1 * momentum[w] + (1 - beta1) * gradient;
+      velocity[w] = beta2 * velocity[w] + (1 - beta2) * gradient * gradient;
+      double m = momentum[w] / (1 - std::pow(beta1, iteration));
+      double v = velocity[w] / (1 - std::pow(beta2, iteration));
+      weights[w] -= options.rate * m / (std::sqrt(v) + epsilon);
+    }
+
+    std::cout << "Iteration " << iteration << ": error " << error << ", "
+              << totals.positions / elapsed.count() << " positions/s" << std::endl;
+    if (iteration % SAVE_INTERVAL == 0 or iteration == options.iterations) {
+      write_weights(options.output, weights, totals.positions, error);
+    }
+  }
+  return 0;
+}